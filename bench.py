@@ -0,0 +1,54 @@
+#!/usr/bin/python
+
+# Benchmark all NeoXmas animations and compare their output with saved checksums
+# Usage: bench.py [--save golden.json | --check golden.json] [frames=N] [seed=S] [circle=MS]
+# Frames are rendered on the device with a fixed clock and seed, so checksums only
+# change if the rendered colors change (e.g. after optimizing an animation).
+
+import json
+import sys
+from urllib.request import urlopen
+
+URL = "http://neoXmas/bench"
+
+save = check = None
+params = []
+args = sys.argv[1:]
+while args:
+  arg = args.pop(0)
+  if arg == '--save':
+    save = args.pop(0)
+  elif arg == '--check':
+    check = args.pop(0)
+  else:
+    params.append(arg)
+
+url = URL + ('?' + '&'.join(params) if params else '')
+bench = json.load(urlopen(url))
+
+golden = {}
+if check:
+  with open(check) as f:
+    reference = json.load(f)
+  if [reference[k] for k in ('frames', 'seed', 'circle')] != [bench[k] for k in ('frames', 'seed', 'circle')]:
+    sys.exit("benchmark parameters differ from " + check)
+  golden = {m['mode']: m for m in reference['modes']}
+
+failed = 0
+print("mode       hash    us/frame   max us   speedup")
+for m in bench['modes']:
+  line = "%4u   %08x   %8u   %6u" % (m['mode'], m['hash'], m['us'], m['usMax'])
+  ref = golden.get(m['mode'])
+  if ref:
+    line += "   %6.2f" % (float(ref['us']) / m['us'] if m['us'] else 0)
+    if ref['hash'] != m['hash']:
+      line += "   CHANGED"
+      failed += 1
+  print(line)
+
+if save:
+  with open(save, 'w') as f:
+    json.dump(bench, f, indent=1)
+
+if failed:
+  sys.exit("%u modes render different frames than %s" % (failed, check))
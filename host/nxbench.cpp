@@ -0,0 +1,336 @@
+// Benchmarks the firmware building blocks on a Linux host.
+// Each case renders frames of a strip and reports the time per frame and its share of the
+// frame interval, assuming the ESP8266 is a given factor slower than the host.
+// On the device /bench measures the real render time of every animation.
+//
+// Build: g++ -O2 -Wall -Isrc -o nxbench host/nxbench.cpp src/noise.cpp src/deepcolor.cpp
+//   Cases specialized for a strip length run only if -n matches one of their instances
+// Usage: nxbench [-n pixels] [-f frames] [-s slowdown]
+
+#include <noise.h>
+#include <deepcolor.h>
+#include <stripanim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <vector>
+
+
+#define INTERVAL_MS 4  // as in the firmware
+
+
+static double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// Renders one frame at time t into colors, returns a checksum to keep the work from being optimized away
+typedef uint32_t (*render_t)( uint32_t t, std::vector<uint32_t> &colors );
+
+
+// Noise coordinates along the strip like the fire animation: strip spans 4 cells
+static inline int32_t stripX( size_t pixel, size_t pixels, uint32_t t ) {
+  return (int32_t)((pixel * 1024) / pixels) - (int32_t)(t * 2);
+}
+
+static uint32_t noise3Direct( uint32_t t, std::vector<uint32_t> &colors ) {
+  uint32_t sum = 0;
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    colors[pixel] = (uint16_t)noise3(stripX(pixel, colors.size(), t), 0, t / 2);
+    sum += colors[pixel];
+  }
+  return sum;
+}
+
+static uint32_t noise3Line( uint32_t t, std::vector<uint32_t> &colors ) {
+  static noiseLine line;
+  uint32_t sum = 0;
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    colors[pixel] = (uint16_t)line.get(stripX(pixel, colors.size(), t), 0, t / 2);
+    sum += colors[pixel];
+  }
+  return sum;
+}
+
+static uint32_t noise2Pixels( uint32_t t, std::vector<uint32_t> &colors ) {
+  uint32_t sum = 0;
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    colors[pixel] = (uint16_t)noise2(pixel * 256 + 128, t * 4);
+    sum += colors[pixel];
+  }
+  return sum;
+}
+
+static uint32_t noise1Strip( uint32_t t, std::vector<uint32_t> &colors ) {
+  uint32_t sum = 0;
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    colors[pixel] = (uint16_t)noise1(stripX(pixel, colors.size(), t));
+    sum += colors[pixel];
+  }
+  return sum;
+}
+
+
+// Final stage of a frame: brightness, current estimate and reduction to 8 bit colors.
+// Input is a slow fade along the strip, brightness 100, current limited to 70%
+#define BENCH_BRIGHTNESS 100
+#define BENCH_LIMIT      (0x10000 * 7 / 10)
+
+static color16_t benchColor( uint32_t t, size_t pixel ) {
+  uint16_t v = (uint16_t)(pixel * 97 + t * 13);
+  color16_t c = { v, (uint16_t)(0xffff - v), (uint16_t)(v / 2) };
+  return c;
+}
+
+// 8 bit pipeline without low bits: two multiplications per color and per scale
+static inline uint32_t scaleColor( uint32_t color, uint32_t scale ) {
+  return ((((color & 0xff00ff) * scale) >> 8) & 0xff00ff) | ((((color & 0x00ff00) * scale) >> 8) & 0x00ff00);
+}
+
+static uint32_t final8Bit( uint32_t t, std::vector<uint32_t> &colors ) {
+  static std::vector<uint32_t> frame;
+  frame.resize(colors.size());
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    frame[pixel] = color8(benchColor(t, pixel));
+  }
+  uint32_t channels = 0;
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    uint32_t color = scaleColor(frame[pixel], BENCH_BRIGHTNESS + 1);
+    channels += (color >> 16) + ((color >> 8) & 0xff) + (color & 0xff);
+    colors[pixel] = color;
+  }
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    colors[pixel] = scaleColor(colors[pixel], BENCH_LIMIT >> 8);
+  }
+  return channels;
+}
+
+static uint32_t final16Bit( uint32_t t, std::vector<uint32_t> &colors, uint8_t *error ) {
+  static std::vector<color16_t> frame, scaled;
+  frame.resize(colors.size());
+  scaled.resize(colors.size());
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    frame[pixel] = benchColor(t, pixel);
+  }
+  uint32_t channels = scaleSpan16(scaled.data(), frame.data(), colors.size(), BENCH_BRIGHTNESS + 1);
+  ditherSpan(scaled.data(), error, colors.data(), colors.size(), BENCH_LIMIT);
+  return channels;
+}
+
+static uint32_t final16Truncated( uint32_t t, std::vector<uint32_t> &colors ) {
+  return final16Bit(t, colors, 0);
+}
+
+static uint32_t final16Dithered( uint32_t t, std::vector<uint32_t> &colors ) {
+  static std::vector<uint8_t> error;
+  error.resize(colors.size() * 3);
+  return final16Bit(t, colors, error.data());
+}
+
+
+// Sine waves to the strip, generic: floats with the strip length at runtime like sine_waves_at(),
+// then each pixel through an RgbColor and SetPixelColor() like NeoPixelBus does it
+#define BENCH_CIRCLE 10000
+
+typedef struct {
+  uint8_t R, G, B;
+} rgbColor_t;
+
+static std::vector<uint8_t> stripBuffer;
+
+static void setPixelColor( uint16_t index, const rgbColor_t &color ) {
+  if( index < stripBuffer.size() / 3 ) {
+    uint8_t *pixel = &stripBuffer[index * 3];
+    pixel[0] = color.R;
+    pixel[1] = color.G;
+    pixel[2] = color.B;
+  }
+}
+
+static uint32_t sineWavesFloat( uint32_t t, size_t pixel, size_t pixels ) {
+  const float frequency = 2.0 * M_PI / BENCH_CIRCLE;
+  const float phaseshift = 2.0 * M_PI / pixels;
+  uint16_t red   = uint16_t(127 * sin(frequency * t - phaseshift * pixel)) + 127;
+  uint16_t green = uint16_t(127 * sin(frequency * t + 3 * phaseshift * pixel)) + 127;
+  uint16_t blue  = uint16_t(127 * sin(frequency * t + 2 * phaseshift * pixel)) + 127;
+  red   = (red   * red  ) / 254;
+  green = (green * green) / 254;
+  blue  = (blue  * blue ) / 254;
+  return (red & 0xff) << 16 | (green & 0xff) << 8 | (blue & 0xff);
+}
+
+static uint32_t wavesGeneric( uint32_t t, std::vector<uint32_t> &colors ) {
+  stripBuffer.resize(colors.size() * 3);
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    colors[pixel] = sineWavesFloat(t, pixel, colors.size());
+  }
+  for( size_t pixel = 0; pixel < colors.size(); pixel++ ) {
+    uint32_t color = colors[pixel];
+    setPixelColor(pixel, rgbColor_t{ (uint8_t)(color >> 16), (uint8_t)(color >> 8), (uint8_t)color });
+  }
+  return stripBuffer[t % stripBuffer.size()];
+}
+
+// Same specialized for N pixels: tables instead of floats, written directly into the buffer
+template<unsigned N>
+static uint32_t wavesSpecialized( uint32_t t, std::vector<uint32_t> &colors ) {
+  stripBuffer.resize(N * 3);
+  for( unsigned pixel = 0; pixel < N; pixel++ ) {
+    colors[pixel] = stripSineWaves<N>(t, pixel, BENCH_CIRCLE);
+  }
+  writeSpan<orderRgb>(stripBuffer.data(), colors.data(), N);
+  return stripBuffer[t % stripBuffer.size()];
+}
+
+
+static const struct {
+  const char *name;
+  render_t render;
+  size_t pixels;  // strip length of a specialized case, 0: any
+} cases[] = {
+  { "noise3 per pixel", noise3Direct },
+  { "noise3 along strip", noise3Line },
+  { "noise2 per pixel", noise2Pixels },
+  { "noise1 along strip", noise1Strip },
+  { "final 8 bit", final8Bit },
+  { "final 16 bit", final16Truncated },
+  { "final 16 bit dithered", final16Dithered },
+  { "waves generic", wavesGeneric },
+  { "waves specialized<50>", wavesSpecialized<50>, 50 },
+  { "waves specialized<300>", wavesSpecialized<300>, 300 }
+};
+
+
+// Incremental evaluation must give the same values as evaluating each pixel
+static bool checkNoiseLine( size_t pixels, uint32_t frames ) {
+  noiseLine line;
+  size_t mismatches = 0;
+  for( uint32_t t = 0; t < frames; t++ ) {
+    for( size_t pixel = 0; pixel < pixels; pixel++ ) {
+      int32_t x = stripX(pixel, pixels, t);
+      if( line.get(x, 0, t / 2) != noise3(x, 0, t / 2) ) {
+        mismatches++;
+      }
+    }
+  }
+  printf("noiseLine: %u cells set up for %zu pixels per frame, %zu mismatches\n",
+    (unsigned)(line.cells() / (frames ? frames : 1)), pixels, mismatches);
+  return mismatches == 0;
+}
+
+
+// The average of dithered frames must show the low bits a single 8 bit frame drops
+static bool checkDither( uint32_t frames ) {
+  static const uint16_t levels[] = { 0x0000, 0x0080, 0x0123, 0x1234, 0x7fff, 0xfe80, 0xffff };
+  const size_t count = sizeof(levels) / sizeof(*levels);
+  color16_t frame[count];
+  uint8_t error[count * 3] = {};
+  uint32_t colors[count];
+  uint32_t sums[count] = {};
+
+  for( size_t i = 0; i < count; i++ ) {
+    frame[i].r = frame[i].g = frame[i].b = levels[i];
+  }
+  for( uint32_t f = 0; f < frames; f++ ) {
+    ditherSpan(frame, error, colors, count, 0x10000);
+    for( size_t i = 0; i < count; i++ ) {
+      sums[i] += colors[i] & 0xff;
+    }
+  }
+
+  uint32_t worst = 0;
+  for( size_t i = 0; i < count; i++ ) {
+    uint32_t average = (uint32_t)(((uint64_t)sums[i] * 257 + frames / 2) / frames);  // back to 16 bits
+    uint32_t diff = average > levels[i] ? average - levels[i] : levels[i] - average;
+    if( diff > worst ) {
+      worst = diff;
+    }
+  }
+  printf("dither: average of %u frames is off by %u/65535 at most\n", frames, worst);
+  return worst <= 257 / frames + 1;  // the summed error stays below one 8 bit step
+}
+
+
+// Specialized sine waves must look like the float version, writeSpan() must give the same buffer as setPixelColor()
+template<unsigned N>
+static bool checkWaves( uint32_t frames ) {
+  std::vector<uint32_t> colors(N);
+  uint32_t worst = 0;
+  size_t mismatches = 0;
+  for( uint32_t t = 0; t < frames * 4; t += 4 ) {
+    wavesGeneric(t, colors);
+    std::vector<uint8_t> generic(stripBuffer);
+    for( unsigned pixel = 0; pixel < N; pixel++ ) {
+      uint32_t a = colors[pixel];
+      uint32_t b = stripSineWaves<N>(t, pixel, BENCH_CIRCLE);
+      for( int shift = 0; shift < 24; shift += 8 ) {
+        uint32_t diff = abs((int)((a >> shift) & 0xff) - (int)((b >> shift) & 0xff));
+        if( diff > worst ) {
+          worst = diff;
+        }
+      }
+    }
+    writeSpan<orderRgb>(stripBuffer.data(), colors.data(), N);
+    if( stripBuffer != generic ) {
+      mismatches++;
+    }
+  }
+  printf("waves<%u>: specialized differs by %u/255 at most, buffer written directly differs in %zu frames\n",
+    N, worst, mismatches);
+  return worst <= 2 && mismatches == 0;
+}
+
+
+int main( int argc, char *argv[] ) {
+  size_t pixels = 300;
+  uint32_t frames = 10000;
+  double slowdown = 100;
+
+  int opt;
+  while( (opt = getopt(argc, argv, "n:f:s:")) != -1 ) {
+    switch( opt ) {
+      case 'n': pixels = strtoul(optarg, 0, 0); break;
+      case 'f': frames = strtoul(optarg, 0, 0); break;
+      case 's': slowdown = strtod(optarg, 0); break;
+      default:
+        fprintf(stderr, "Usage: %s [-n pixels] [-f frames] [-s slowdown]\n", argv[0]);
+        return 1;
+    }
+  }
+  if( pixels == 0 || frames == 0 ) {
+    fprintf(stderr, "pixels and frames must be > 0\n");
+    return 1;
+  }
+
+  bool ok = checkNoiseLine(pixels, 1000);
+  ok = checkDither(1024) && ok;
+  ok = checkWaves<50>(1000) && ok;
+
+  std::vector<uint32_t> colors(pixels);
+  printf("%-22s %12s %14s %10s\n", "case", "host ns", "device us", "interval");
+  for( const auto &c : cases ) {
+    if( c.pixels && c.pixels != pixels ) {
+      continue;
+    }
+    uint32_t sum = 0;
+    double start = now();
+    for( uint32_t frame = 0; frame < frames; frame++ ) {
+      sum += c.render(frame * INTERVAL_MS, colors);
+    }
+    double frameUs = (now() - start) / frames * 1e6;
+    printf("%-22s %12.0f %14.1f %9.1f%%  (%08x)\n", c.name, frameUs * 1e3, frameUs * slowdown,
+      frameUs * slowdown / (INTERVAL_MS * 10.0), sum);
+  }
+  printf("%zu pixels, %u frames, device %.0f times slower than host, interval %d ms\n",
+    pixels, frames, slowdown, INTERVAL_MS);
+
+  return ok ? 0 : 1;
+}
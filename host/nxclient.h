@@ -0,0 +1,207 @@
+#ifndef _nxclient_h
+#define _nxclient_h
+
+// Host side NeoXmas UDP streaming (Linux)
+
+#include <nxproto.h>
+
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <vector>
+#include <string>
+
+
+// A frame of pixel blocks, built in place and reused for each send
+class nxFrame {
+public:
+  nxFrame( unsigned numPixels ) : _blocks(numPixels * NX_BLOCK_SIZE) {
+    for( unsigned pixel = 0; pixel < numPixels; pixel++ ) {
+      _blocks[pixel * NX_BLOCK_SIZE] = pixel;
+    }
+  }
+
+  void set( unsigned pixel, uint8_t r, uint8_t g, uint8_t b ) {
+    uint8_t *block = &_blocks[pixel * NX_BLOCK_SIZE];
+    block[1] = r;
+    block[2] = g;
+    block[3] = b;
+  }
+
+  unsigned pixels() const { return _blocks.size() / NX_BLOCK_SIZE; }
+  const uint8_t *data() const { return _blocks.data(); }
+  size_t size() const { return _blocks.size(); }
+
+private:
+  std::vector<uint8_t> _blocks;
+};
+
+
+// A span packet with pixels from start of a pixel space shared by several controllers
+class nxSpanFrame {
+public:
+  nxSpanFrame( unsigned numPixels, unsigned start = 0 ) : _packet(sizeof(span_t) + numPixels * 3) {
+    memcpy(_packet.data(), SPAN_MAGIC, sizeof(((span_t *)0)->magic));
+    _packet[4] = start & 0xff;
+    _packet[5] = start >> 8;
+    _packet[6] = numPixels & 0xff;
+    _packet[7] = numPixels >> 8;
+  }
+
+  void set( unsigned pixel, uint8_t r, uint8_t g, uint8_t b ) {
+    uint8_t *rgb = &_packet[sizeof(span_t) + pixel * 3];
+    rgb[0] = r;
+    rgb[1] = g;
+    rgb[2] = b;
+  }
+
+  unsigned pixels() const { return (_packet.size() - sizeof(span_t)) / 3; }
+  const uint8_t *data() const { return _packet.data(); }
+  size_t size() const { return _packet.size(); }
+
+private:
+  std::vector<uint8_t> _packet;
+};
+
+
+// Sends the same datagram to several controllers with one sendmmsg() call
+class nxClient {
+public:
+  nxClient() : _fd(socket(AF_INET, SOCK_DGRAM, 0)) {
+  }
+
+  ~nxClient() {
+    if( _fd >= 0 ) {
+      close(_fd);
+    }
+  }
+
+  // Add a controller by host name or address. Returns false if not resolvable
+  bool add( const char *host, uint16_t port = NX_PORT ) {
+    addrinfo hints = {};
+    addrinfo *result;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if( getaddrinfo(host, std::to_string(port).c_str(), &hints, &result) != 0 ) {
+      return false;
+    }
+    _targets.push_back(*(sockaddr_in *)result->ai_addr);
+    freeaddrinfo(result);
+    return true;
+  }
+
+  // Send multicast packets via the interface with this address (e.g. 127.0.0.1 for local tests)
+  bool multicastInterface( const char *address ) {
+    in_addr addr;
+    return inet_aton(address, &addr) && setsockopt(_fd, IPPROTO_IP, IP_MULTICAST_IF, &addr, sizeof(addr)) == 0;
+  }
+
+  // Send data to all controllers. Returns number of controllers sent to
+  int send( const void *data, size_t size ) {
+    iovec iov = { const_cast<void *>(data), size };
+    _msgs.resize(_targets.size());
+    for( size_t i = 0; i < _targets.size(); i++ ) {
+      msghdr &hdr = _msgs[i].msg_hdr;
+      hdr = msghdr();
+      hdr.msg_name = &_targets[i];
+      hdr.msg_namelen = sizeof(_targets[i]);
+      hdr.msg_iov = &iov;
+      hdr.msg_iovlen = 1;
+    }
+    return sendmmsg(_fd, _msgs.data(), _msgs.size(), 0);
+  }
+
+  int send( const nxFrame &frame ) {
+    return send(frame.data(), frame.size());
+  }
+
+  int send( const nxSpanFrame &frame ) {
+    return send(frame.data(), frame.size());
+  }
+
+  bool ok() const { return _fd >= 0; }
+  size_t targets() const { return _targets.size(); }
+
+private:
+  nxClient( const nxClient & );
+
+  int _fd;
+  std::vector<sockaddr_in> _targets;
+  std::vector<mmsghdr> _msgs;
+};
+
+
+// Paces frames at absolute deadlines, so delays don't accumulate, and collects timing statistics
+class nxPacer {
+public:
+  nxPacer( double fps ) : _intervalNs(1e9 / fps), _frames(0), _lateSum(0), _lateSqSum(0), _lateMax(0) {
+    clock_gettime(CLOCK_MONOTONIC, &_start);
+    _next = _start;
+  }
+
+  // Sleep until the next frame is due. Returns seconds since the first frame
+  double wait() {
+    if( _frames ) {
+      _next.tv_nsec += _intervalNs;
+      while( _next.tv_nsec >= 1000000000L ) {
+        _next.tv_nsec -= 1000000000L;
+        _next.tv_sec++;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &_next, 0);
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double late = seconds(_next, now);
+    _frames++;
+    _lateSum += late;
+    _lateSqSum += late * late;
+    if( late > _lateMax ) {
+      _lateMax = late;
+    }
+    return seconds(_start, _next);
+  }
+
+  unsigned long frames() const { return _frames; }
+
+  // Achieved frames per second so far
+  double fps() const {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = seconds(_start, now);
+    return elapsed > 0 ? _frames / elapsed : 0;
+  }
+
+  // Mean, standard deviation and max of wakeup times after the deadlines in seconds
+  double jitterMean() const { return _frames ? _lateSum / _frames : 0; }
+  double jitterMax() const { return _lateMax; }
+  double jitterStddev() const {
+    if( !_frames ) {
+      return 0;
+    }
+    double mean = jitterMean();
+    double var = _lateSqSum / _frames - mean * mean;
+    return var > 0 ? sqrt(var) : 0;
+  }
+
+private:
+  static double seconds( const timespec &from, const timespec &to ) {
+    return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) * 1e-9;
+  }
+
+  long _intervalNs;
+  timespec _start;
+  timespec _next;
+  unsigned long _frames;
+  double _lateSum;
+  double _lateSqSum;
+  double _lateMax;
+};
+
+#endif
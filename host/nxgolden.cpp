@@ -0,0 +1,325 @@
+// Golden checksums of the firmware animations on a Linux host.
+// Renders every entry of animators[] (src/animations.cpp) with the fixed clock, spark seed and
+// circle of the device /bench defaults and compares an FNV-1a checksum of the frames with the
+// values committed in host/golden.txt. The seeded xorshift32 sequence and the first colors of
+// random and themed sparks are compared too, they must be the same on the device.
+// Periodic animators are recorded into a frame cache from t = 0 and must match their live frames.
+// Changed output of an optimized animator shows up as a mismatch, the render time per frame of
+// each mode is shown next to its checksum. Run with -w to write the golden file after an intended
+// change. Exits with 1 on any error.
+//
+// Build: g++ -O2 -Wall -Isrc -o nxgolden host/nxgolden.cpp src/animations.cpp src/spark.cpp
+//   src/vm.cpp src/noise.cpp src/pixelmap.cpp src/deepcolor.cpp src/framecache.cpp
+// Usage: nxgolden [-g golden file] [-w] [-v]
+
+#include <animations.h>
+#include <framecache.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+
+
+#define INTERVAL_MS 4      // as in the firmware
+#define BENCH_FRAMES 100   // defaults of /bench
+#define BENCH_SEED 1
+#define BENCH_CIRCLE 10000
+#define RANDOM_VALUES 16   // checked values of the seeded sequence
+#define SPARK_COLORS 8     // checked colors of each spark type
+#define CACHE_BUDGET 0x10000  // enough for a circle of the checked circle times
+
+// Custom program used for mode 28, red waves as in the README
+#define BENCH_PROGRAM "p i 2000 * + sin 8 >> 128 + 0 0 rgb"
+
+
+// The firmware loads uploaded palettes from flash, here there are only the builtin themes
+bool loadPalette( unsigned index, sparkPalette &palette ) {
+  return false;
+}
+
+// No recorded show on the host
+uint32_t replay( uint32_t t, unsigned pixel ) {
+  return 0x000000;
+}
+
+
+// FNV-1a over r, g, b of colors, as /bench
+static uint32_t hashColors( uint32_t hash, const uint32_t colors[], unsigned count ) {
+  for( unsigned pixel = 0; pixel < count; pixel++ ) {
+    for( int shift = 16; shift >= 0; shift -= 8 ) {
+      hash = (hash ^ ((colors[pixel] >> shift) & 0xff)) * 16777619UL;
+    }
+  }
+  return hash;
+}
+
+
+// Monotonic clock in ns
+static uint64_t nanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// Render frames of mode like /bench and return their checksum and the average render time
+static uint32_t renderMode( uint32_t benchMode, uint32_t frames, uint32_t benchSeed, uint32_t benchCircle, uint64_t &nsFrame ) {
+  mode = benchMode;
+  msCircle = benchCircle;
+  prevMode = mode + 1; // forces init
+  sparkRandom::seed(benchSeed);
+
+  uint32_t hash = 2166136261UL;
+  uint64_t ns = 0;
+  for( uint32_t frame = 0; frame < frames; frame++ ) {
+    uint32_t colors[NUM_PIXELS];
+    uint32_t t = benchCircle + frame * INTERVAL_MS;
+    uint64_t start = nanos();
+    for( unsigned pixel = 0; pixel < NUM_PIXELS; pixel++ ) {
+      colors[pixel] = (*animators[mode])(t, pixel);
+    }
+    ns += nanos() - start;
+    prevMode = mode;
+    hash = hashColors(hash, colors, NUM_PIXELS);
+  }
+  nsFrame = frames ? ns / frames : 0;
+  return hash;
+}
+
+
+// Sparks showing their target color
+template<typename S>
+class sparkProbe : public S {
+public:
+  uint32_t color() const { return this->_color.r << 16 | this->_color.g << 8 | this->_color.b; }
+};
+
+
+// First values of the seeded random sequence and colors of sparks reset after seeding
+template<typename G>
+static void checkRandom( G &values, uint32_t seed ) {
+  char key[24];
+
+  sparkRandom::seed(seed);
+  for( unsigned i = 0; i < RANDOM_VALUES; i++ ) {
+    snprintf(key, sizeof(key), "random%02u", i);
+    values.check(key, sparkRandom::next());
+  }
+
+  sparkProbe<randomSpark> random;
+  sparkRandom::seed(seed);
+  for( unsigned i = 0; i < SPARK_COLORS; i++ ) {
+    random.reset();
+    snprintf(key, sizeof(key), "randomSpark%02u", i);
+    values.check(key, random.color());
+  }
+
+  sparkProbe<themedSpark> themed;
+  themed.setTheme(&getPalette(0));
+  sparkRandom::seed(seed);
+  for( unsigned i = 0; i < SPARK_COLORS; i++ ) {
+    themed.reset();
+    snprintf(key, sizeof(key), "themedSpark%02u", i);
+    values.check(key, themed.color());
+  }
+}
+
+
+// Record one circle of each periodic mode into a frame cache from t = 0 and compare it with
+// the live frames some circles later, as the firmware plays them. Expects no differing frames
+template<typename G>
+static void checkCache( G &values, uint32_t circle ) {
+  static const uint32_t circles[] = { 1, 7, 1000 };  // live frames this many circles later
+  char key[24];
+
+  msCircle = circle;
+  for( uint32_t m = 0; m < NUM_MODES; m++ ) {
+    animator_t anim = animators[m];
+    if( !isPeriodic(anim) ) {
+      continue;
+    }
+    mode = m;
+    prevMode = mode + 1;
+
+    frameCache frames;
+    uint32_t colors[NUM_PIXELS];
+    frames.begin((circle + INTERVAL_MS - 1) / INTERVAL_MS, NUM_PIXELS, CACHE_BUDGET);
+    while( frames.recording() ) {
+      uint32_t t = frames.added() * INTERVAL_MS;
+      for( unsigned pixel = 0; pixel < NUM_PIXELS; pixel++ ) {
+        colors[pixel] = (*anim)(t, pixel);
+      }
+      prevMode = mode;
+      frames.add(colors);
+    }
+
+    uint32_t differing = frames.ready() ? 0 : frames.frames();
+    for( uint32_t frame = 0; frames.ready() && frame < frames.frames(); frame++ ) {
+      uint32_t cached[NUM_PIXELS];
+      frames.get(frame, [&cached]( uint16_t pixel, uint8_t r, uint8_t g, uint8_t b ) {
+        cached[pixel] = r << 16 | g << 8 | b;
+      });
+      for( size_t i = 0; i < sizeof(circles)/sizeof(*circles); i++ ) {
+        uint32_t t = circles[i] * circle + frame * INTERVAL_MS;
+        for( unsigned pixel = 0; pixel < NUM_PIXELS; pixel++ ) {
+          colors[pixel] = (*anim)(t, pixel);
+        }
+        if( memcmp(cached, colors, sizeof(colors)) != 0 ) {
+          differing++;
+          break;
+        }
+      }
+    }
+
+    snprintf(key, sizeof(key), "cache%02u-%u", m, circle);
+    values.expect(key, differing, 0);
+  }
+}
+
+
+// Golden values by name: compared with the file or collected for writing it
+class golden {
+public:
+  golden( bool write, bool verbose ) : _write(write), _verbose(verbose), _checks(0), _errors(0) {}
+
+  bool load( const char *name ) {
+    FILE *file = fopen(name, "r");
+    if( !file ) {
+      return false;
+    }
+    char line[128];
+    while( fgets(line, sizeof(line), file) ) {
+      char key[64];
+      unsigned long value;
+      if( line[0] != '#' && sscanf(line, "%63s %lx", key, &value) == 2 ) {
+        _values[key] = value;
+      }
+    }
+    fclose(file);
+    return true;
+  }
+
+  bool save( const char *name ) const {
+    FILE *file = fopen(name, "w");
+    if( !file ) {
+      return false;
+    }
+    fprintf(file, "# nxgolden: frames %u, seed %u, circle %u ms, %u pixels\n",
+      BENCH_FRAMES, BENCH_SEED, BENCH_CIRCLE, NUM_PIXELS);
+    for( std::map<std::string, uint32_t>::const_iterator it = _values.begin(); it != _values.end(); ++it ) {
+      fprintf(file, "%s 0x%08x\n", it->first.c_str(), it->second);
+    }
+    return fclose(file) == 0;
+  }
+
+  // A note is shown with the value, also if it matches
+  void check( const std::string &key, uint32_t value, const char *note = "" ) {
+    _checks++;
+    if( _write ) {
+      _values[key] = value;
+      if( *note ) {
+        printf("%-14s 0x%08x  %s\n", key.c_str(), value, note);
+      }
+    }
+    else if( _values.find(key) == _values.end() ) {
+      printf("%-14s 0x%08x  %s  no golden value\n", key.c_str(), value, note);
+      _errors++;
+    }
+    else if( _values[key] != value ) {
+      printf("%-14s 0x%08x  %s  differs from golden 0x%08x\n", key.c_str(), value, note, _values[key]);
+      _errors++;
+    }
+    else if( _verbose || *note ) {
+      printf("%-14s 0x%08x  %s  ok\n", key.c_str(), value, note);
+    }
+  }
+
+  // Same for a value known in advance
+  void expect( const std::string &key, uint32_t value, uint32_t expected ) {
+    _checks++;
+    if( value != expected ) {
+      printf("%-14s %10u  expected %u\n", key.c_str(), value, expected);
+      _errors++;
+    }
+    else if( _verbose ) {
+      printf("%-14s %10u  ok\n", key.c_str(), value);
+    }
+  }
+
+  unsigned checks() const { return _checks; }
+  unsigned errors() const { return _errors; }
+  size_t size() const { return _values.size(); }
+
+private:
+  bool _write;
+  bool _verbose;
+  unsigned _checks;
+  unsigned _errors;
+  std::map<std::string, uint32_t> _values;
+};
+
+
+int main( int argc, char *argv[] ) {
+  const char *goldenFile = "host/golden.txt";
+  bool write = false;
+  bool verbose = false;
+
+  int opt;
+  while( (opt = getopt(argc, argv, "g:wv")) != -1 ) {
+    switch( opt ) {
+      case 'g': goldenFile = optarg; break;
+      case 'w': write = true; break;
+      case 'v': verbose = true; break;
+      default:
+        fprintf(stderr, "Usage: %s [-g golden file] [-w] [-v]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  golden values(write, verbose);
+  if( !write && !values.load(goldenFile) ) {
+    fprintf(stderr, "Can't read golden file %s\n", goldenFile);
+    return 1;
+  }
+
+  // Same setup as the firmware without uploads: pixels on a vertical line
+  mapLinear(positions, NUM_PIXELS);
+  mapProject(positions, projections, NUM_PIXELS);
+  if( !program.compile(BENCH_PROGRAM) ) {
+    fprintf(stderr, "Program error: %s\n", program.error());
+    return 1;
+  }
+
+  checkRandom(values, BENCH_SEED);
+
+  for( uint32_t m = 0; m < NUM_MODES; m++ ) {
+    char key[16], note[32];
+    uint64_t nsFrame;
+    uint32_t hash = renderMode(m, BENCH_FRAMES, BENCH_SEED, BENCH_CIRCLE, nsFrame);
+    snprintf(key, sizeof(key), "mode%02u", m);
+    snprintf(note, sizeof(note), "%8llu ns/frame", (unsigned long long)nsFrame);
+    values.check(key, hash, note);
+  }
+
+  checkCache(values, 100);
+  checkCache(values, 1234);
+
+  if( write ) {
+    if( !values.save(goldenFile) ) {
+      fprintf(stderr, "Can't write golden file %s\n", goldenFile);
+      return 1;
+    }
+    printf("%zu golden values written to %s\n", values.size(), goldenFile);
+    return 0;
+  }
+
+  printf("%u of %u checks failed\n", values.errors(), values.checks());
+  return values.errors() ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+// Stress test of the firmware frame queue (src/framequeue.h) with a producer and a consumer thread.
+// The producer renders numbered frames with a pattern derived from the number, the consumer checks
+// that every frame arrives once, in order and complete. Random busy waits on both sides vary the
+// contention between a full and an empty queue. Exits with 1 on any error.
+//
+// Build: g++ -O2 -Wall -pthread -Isrc -o nxqueue host/nxqueue.cpp
+//   (add -fsanitize=thread to let the thread sanitizer check the memory ordering too)
+// Usage: nxqueue [-f frames] [-n pixels] [-w max busy wait loops]
+
+#define FRAMEQUEUE_ALIGN 64
+#include <framequeue.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <thread>
+
+
+#define MAX_PIXELS 1024
+#define QUEUE_SIZE 4  // as FRAME_QUEUE in the firmware
+
+typedef struct {
+  uint32_t number;
+  uint32_t pixels;
+  uint32_t colors[MAX_PIXELS];
+} frame_t;
+
+
+static double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline uint32_t pattern( uint32_t number, uint32_t pixel ) {
+  return (number * 0x9e3779b1UL) ^ (pixel * 0x85ebca77UL);
+}
+
+// Spin a random number of loops below max, so both threads change speed all the time
+static void busyWait( uint32_t &state, uint32_t max ) {
+  if( max ) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    for( volatile uint32_t i = state % max; i > 0; i-- );
+  }
+}
+
+
+static frameQueue<frame_t, QUEUE_SIZE> queue;
+
+
+int main( int argc, char *argv[] ) {
+  uint32_t frames = 1000000;
+  uint32_t pixels = 300;
+  uint32_t wait = 200;
+
+  int opt;
+  while( (opt = getopt(argc, argv, "f:n:w:")) != -1 ) {
+    switch( opt ) {
+      case 'f': frames = strtoul(optarg, 0, 0); break;
+      case 'n': pixels = strtoul(optarg, 0, 0); break;
+      case 'w': wait = strtoul(optarg, 0, 0); break;
+      default:
+        fprintf(stderr, "Usage: %s [-f frames] [-n pixels] [-w max busy wait loops]\n", argv[0]);
+        return 1;
+    }
+  }
+  if( pixels > MAX_PIXELS ) {
+    fprintf(stderr, "max %u pixels\n", MAX_PIXELS);
+    return 1;
+  }
+
+  uint64_t full = 0;   // producer found no free slot
+  uint64_t empty = 0;  // consumer found no frame
+  uint32_t errors = 0;
+  uint32_t received = 0;
+
+  double start = now();
+
+  std::thread producer([&]() {
+    uint32_t state = 1;
+    for( uint32_t number = 0; number < frames; number++ ) {
+      frame_t *frame;
+      while( !(frame = queue.write()) ) {
+        full++;
+        std::this_thread::yield(); // let the consumer run, if there are less cores than threads
+      }
+      frame->number = number;
+      frame->pixels = pixels;
+      for( uint32_t pixel = 0; pixel < pixels; pixel++ ) {
+        frame->colors[pixel] = pattern(number, pixel);
+      }
+      queue.push();
+      busyWait(state, wait);
+    }
+  });
+
+  std::thread consumer([&]() {
+    uint32_t state = 2;
+    while( received < frames ) {
+      frame_t *frame = queue.front();
+      if( !frame ) {
+        empty++;
+        std::this_thread::yield();
+        continue;
+      }
+      bool ok = frame->number == received && frame->pixels == pixels;
+      for( uint32_t pixel = 0; ok && pixel < pixels; pixel++ ) {
+        ok = frame->colors[pixel] == pattern(received, pixel);
+      }
+      if( !ok && errors++ < 10 ) {
+        fprintf(stderr, "frame %u: got frame %u with wrong content or order\n", received, frame->number);
+      }
+      queue.pop();
+      received++;
+      busyWait(state, wait);
+    }
+  });
+
+  producer.join();
+  consumer.join();
+
+  double seconds = now() - start;
+  printf("%u frames of %u pixels in %.2f s: %.0f frames/s, queue full %llu, empty %llu times, %u errors\n",
+    received, pixels, seconds, received / seconds, (unsigned long long)full, (unsigned long long)empty, errors);
+
+  return errors || queue.size() ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+// Receives NeoXmas UDP packets like the firmware does and simulates the strip on a Linux host.
+// Reports packets/s, decode time per packet and packets dropped by the socket,
+// so the packet rate and strip size where the receive path saturates can be found.
+//
+// Build: g++ -O2 -Wall -Isrc -Ihost -o nxsim host/nxsim.cpp
+// Usage: nxsim [-n pixels] [-p port] [-t] [-o frames.ppm] [-m max frames] [-g group [-i interface]] [-s slice]
+//   -t shows the strip in the terminal (24 bit color), -o dumps one row per packet to a PPM image
+//   -g joins a multicast group (via the interface with the given address) like the firmware /cfg?group=,
+//   -s is the first pixel of the strip in the shared pixel space of span packets, like /cfg?slice=
+//   Several instances can listen on the same port, e.g. one per slice
+
+#include <nxproto.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <vector>
+
+
+static volatile sig_atomic_t running = 1;
+
+static void stop( int ) {
+  running = 0;
+}
+
+static double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// Simulated strip, state of the pixels after each packet
+class strip {
+public:
+  strip( unsigned numPixels, unsigned slice ) : _rgb(numPixels * 3), _slice(slice), _brightness(255) {
+  }
+
+  // Handle one packet like setAnimationPixels(). Returns true if pixels changed
+  bool handle( const uint8_t *packet, size_t size ) {
+    bool rc = false;
+    if( nxIsControl(packet, size) ) {
+      control_t ctl;
+      memcpy(&ctl, packet, sizeof(ctl));
+      if( ctl.flags & CONTROL_BRIGHTNESS ) {
+        _brightness = ctl.brightness;
+      }
+      return false;
+    }
+    auto set = [this, &rc]( uint16_t pixel, uint8_t r, uint8_t g, uint8_t b ) {
+      uint8_t *rgb = &_rgb[pixel * 3];
+      if( _brightness < 255 ) {
+        r = (r * (_brightness + 1)) >> 8;
+        g = (g * (_brightness + 1)) >> 8;
+        b = (b * (_brightness + 1)) >> 8;
+      }
+      if( rgb[0] != r || rgb[1] != g || rgb[2] != b ) {
+        rgb[0] = r;
+        rgb[1] = g;
+        rgb[2] = b;
+        rc = true;
+      }
+    };
+    if( nxIsSpan(packet, size) ) {
+      _spanPixels += nxDecodeSpan(packet, size, _slice, pixels(), set);
+    }
+    else {
+      nxDecodeBlocks(packet, size, pixels(), set);
+    }
+    return rc;
+  }
+
+  // Pixels of our slice set by span packets so far
+  unsigned long spanPixels() const { return _spanPixels; }
+
+  unsigned pixels() const { return _rgb.size() / 3; }
+  const uint8_t *rgb() const { return _rgb.data(); }
+
+  // Show as one line of colored blocks in the terminal
+  void print() const {
+    printf("\r");
+    for( size_t i = 0; i < _rgb.size(); i += 3 ) {
+      printf("\033[48;2;%u;%u;%um ", _rgb[i], _rgb[i+1], _rgb[i+2]);
+    }
+    printf("\033[0m");
+    fflush(stdout);
+  }
+
+private:
+  std::vector<uint8_t> _rgb;
+  unsigned _slice;
+  unsigned long _spanPixels = 0;
+  uint8_t _brightness;
+};
+
+
+int main( int argc, char *argv[] ) {
+  unsigned numPixels = 50;
+  uint16_t port = NX_PORT;
+  bool terminal = false;
+  const char *ppm = 0;
+  unsigned maxFrames = 10000;
+  const char *group = 0;
+  const char *interface = "0.0.0.0";
+  unsigned slice = 0;
+
+  int opt;
+  while( (opt = getopt(argc, argv, "n:p:to:m:g:i:s:")) != -1 ) {
+    switch( opt ) {
+      case 'n': numPixels = atoi(optarg); break;
+      case 'p': port = atoi(optarg); break;
+      case 't': terminal = true; break;
+      case 'o': ppm = optarg; break;
+      case 'm': maxFrames = atoi(optarg); break;
+      case 'g': group = optarg; break;
+      case 'i': interface = optarg; break;
+      case 's': slice = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n pixels] [-p port] [-t] [-o frames.ppm] [-m max frames] "
+          "[-g group [-i interface]] [-s slice]\n", argv[0]);
+        return 1;
+    }
+  }
+  if( numPixels == 0 || numPixels > 256 ) {
+    fprintf(stderr, "pixels must be 1-256\n");
+    return 1;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)); // report dropped packets
+  timeval timeout = { 0, 100000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)); // several simulated strips on one host
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if( bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 ) {
+    perror("bind");
+    return 1;
+  }
+  if( group ) {
+    ip_mreq mreq = {};
+    if( !inet_aton(group, &mreq.imr_multiaddr) || !inet_aton(interface, &mreq.imr_interface)
+      || setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0 ) {
+      perror(group);
+      return 1;
+    }
+  }
+  fprintf(stderr, "Listening on UDP port %u%s%s for %u pixels, slice from pixel %u\n",
+    port, group ? " and group " : "", group ? group : "", numPixels, slice);
+
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  strip pixels(numPixels, slice);
+  std::vector<uint8_t> frames; // rows of ppm image
+  uint8_t packet[1500];        // like the firmware, blocks beyond numPixels are ignored
+  char control[CMSG_SPACE(sizeof(uint32_t))];
+  ssize_t readMax = numPixels * NX_BLOCK_SIZE > NX_PACKET_MAX ? numPixels * NX_BLOCK_SIZE : NX_PACKET_MAX;
+
+  unsigned long packets = 0, changed = 0, totalPackets = 0;
+  uint32_t dropped = 0, droppedBefore = 0;
+  double decodeTime = 0, decodeMax = 0;
+  double shown = 0;
+  double reported = now();
+
+  while( running ) {
+    iovec iov = { packet, sizeof(packet) };
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t size = recvmsg(fd, &msg, 0);
+    if( size >= 0 ) {
+      for( cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg) ) {
+        if( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL ) {
+          memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+        }
+      }
+
+      double start = now();
+      if( pixels.handle(packet, size < readMax ? size : readMax) ) {
+        changed++;
+      }
+      double elapsed = now() - start;
+      decodeTime += elapsed;
+      if( elapsed > decodeMax ) {
+        decodeMax = elapsed;
+      }
+      packets++;
+      totalPackets++;
+
+      if( ppm && frames.size() < (size_t)maxFrames * numPixels * 3 ) {
+        frames.insert(frames.end(), pixels.rgb(), pixels.rgb() + numPixels * 3);
+      }
+      if( terminal && start - shown >= 1.0 / 30 ) {
+        shown = start;
+        pixels.print();
+      }
+    }
+
+    double t = now();
+    if( t - reported >= 1 ) {
+      if( terminal ) {
+        printf("\n");
+      }
+      printf("%.0f packets/s, %lu changed, decode %.2f us avg %.2f us max, %u dropped\n",
+        packets / (t - reported), changed, packets ? decodeTime / packets * 1e6 : 0, decodeMax * 1e6,
+        dropped - droppedBefore);
+      fflush(stdout);
+      droppedBefore = dropped;
+      packets = changed = 0;
+      decodeTime = decodeMax = 0;
+      reported = t;
+    }
+  }
+
+  close(fd);
+  printf("\n%lu packets, %lu span pixels of slice, %u dropped\n", totalPackets, pixels.spanPixels(), dropped);
+
+  if( ppm ) {
+    FILE *f = fopen(ppm, "wb");
+    if( !f ) {
+      perror(ppm);
+      return 1;
+    }
+    fprintf(f, "P6\n%u %zu\n255\n", numPixels, frames.size() / (numPixels * 3));
+    fwrite(frames.data(), 1, frames.size(), f);
+    fclose(f);
+  }
+
+  return 0;
+}
@@ -0,0 +1,206 @@
+// Streams red, green and blue sine waves interfering to NeoXmas controllers via UDP
+// (like udp_sin.py, but with precise pacing and one sendmmsg() for all controllers)
+//
+// Build: g++ -O2 -Wall -Isrc -Ihost -o nxstream host/nxstream.cpp -lpthread
+// Usage: nxstream [-f fps] [-n pixels] [-s seconds] [-p port] [-l] [-S] [-i interface] host...
+//   -l starts a receiver on 127.0.0.1 that decodes the frames (no hosts needed)
+//   -S sends span packets of a shared pixel space, e.g. to a multicast group of controllers
+//   -i sends multicast packets via the interface with this address
+
+#include <nxclient.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
+
+#include <atomic>
+#include <thread>
+
+
+// Loopback stand-in for a controller: counts packets and decoded pixels
+class loopbackReceiver {
+public:
+  loopbackReceiver( uint16_t port, unsigned numPixels ) : _fd(socket(AF_INET, SOCK_DGRAM, 0)),
+    _numPixels(numPixels), _running(true), _packets(0), _pixels(0), _bad(0) {
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    timeval timeout = { 0, 100000 };
+    setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if( bind(_fd, (sockaddr *)&addr, sizeof(addr)) != 0 ) {
+      perror("bind");
+      exit(1);
+    }
+    _thread = std::thread(&loopbackReceiver::run, this);
+  }
+
+  ~loopbackReceiver() {
+    _running = false;
+    _thread.join();
+    close(_fd);
+  }
+
+  unsigned long packets() const { return _packets; }
+  unsigned long pixels() const { return _pixels; }
+  unsigned long bad() const { return _bad; }
+
+private:
+  void run() {
+    uint8_t packet[1500];
+    while( _running ) {
+      ssize_t size = recv(_fd, packet, sizeof(packet), 0);
+      if( size <= 0 ) {
+        continue;
+      }
+      unsigned decoded = 0;
+      bool complete;
+      if( nxIsSpan(packet, size) ) {
+        nxDecodeSpan(packet, size, 0, _numPixels, [&decoded]( uint16_t, uint8_t, uint8_t, uint8_t ) {
+          decoded++;
+        });
+        complete = size == (ssize_t)(sizeof(span_t) + _numPixels * 3);
+      }
+      else {
+        nxDecodeBlocks(packet, size, _numPixels, [&decoded]( uint8_t, uint8_t, uint8_t, uint8_t ) {
+          decoded++;
+        });
+        complete = size % NX_BLOCK_SIZE == 0;
+      }
+      _packets++;
+      _pixels += decoded;
+      if( decoded != _numPixels || !complete ) {
+        _bad++;
+      }
+    }
+  }
+
+  int _fd;
+  unsigned _numPixels;
+  std::atomic<bool> _running;
+  std::atomic<unsigned long> _packets;
+  std::atomic<unsigned long> _pixels;
+  std::atomic<unsigned long> _bad;
+  std::thread _thread;
+};
+
+
+int main( int argc, char *argv[] ) {
+  double fps = 30;          // update frequency in Hz
+  unsigned leds = 50;       // used leds
+  double duration = 0;      // s to stream, 0: forever
+  uint16_t port = NX_PORT;
+  bool loopback = false;
+  bool span = false;
+  const char *interface = 0;
+
+  int opt;
+  while( (opt = getopt(argc, argv, "f:n:s:p:lSi:")) != -1 ) {
+    switch( opt ) {
+      case 'f': fps = atof(optarg); break;
+      case 'n': leds = atoi(optarg); break;
+      case 's': duration = atof(optarg); break;
+      case 'p': port = atoi(optarg); break;
+      case 'l': loopback = true; break;
+      case 'S': span = true; break;
+      case 'i': interface = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-f fps] [-n pixels] [-s seconds] [-p port] [-l] [-S] [-i interface] host...\n", argv[0]);
+        return 1;
+    }
+  }
+  unsigned maxLeds = span ? NX_SPAN_PIXELS : 256;
+  if( fps <= 0 || leds == 0 || leds > maxLeds || (!loopback && optind >= argc) ) {
+    fprintf(stderr, "usage: %s [-f fps] [-n pixels (1-%u)] [-s seconds] [-p port] [-l] [-S] [-i interface] host...\n",
+      argv[0], maxLeds);
+    return 1;
+  }
+
+  nxClient client;
+  if( !client.ok() ) {
+    perror("socket");
+    return 1;
+  }
+  if( interface && !client.multicastInterface(interface) ) {
+    fprintf(stderr, "cannot send multicast via %s\n", interface);
+    return 1;
+  }
+  for( int i = optind; i < argc; i++ ) {
+    if( !client.add(argv[i], port) ) {
+      fprintf(stderr, "cannot resolve %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  loopbackReceiver *receiver = 0;
+  if( loopback ) {
+    receiver = new loopbackReceiver(port, leds);
+    client.add("127.0.0.1", port);
+  }
+
+  const double offset = 255 / 2.0;          // moves center of wave to middle of available range of 0 - 255
+  const double amplitude = 255 - offset;    // wave around offset
+  const double looptime = 15.0;             // s of one wave going through all leds
+  const double dt = looptime / leds;        // time shift between leds
+  const double freq = 1 / looptime;         // base frequency for one wave over all leds
+
+  nxFrame frame(span ? 0 : leds);
+  nxSpanFrame spanFrame(span ? leds : 0);
+  nxPacer pacer(fps);
+  unsigned long sent = 0;
+  unsigned long failed = 0;
+  unsigned long reported = 0;
+
+  for( ;; ) {
+    double t0 = pacer.wait();
+    if( duration > 0 && t0 >= duration ) {
+      break;
+    }
+
+    for( unsigned led = 0; led < leds; led++ ) {
+      double t_fwd = t0 + led * dt;
+      double t_bck = t0 - led * dt;
+
+      double red   = amplitude * sin(2 * M_PI * (freq*2) * t_fwd) + offset;
+      double green = amplitude * sin(2 * M_PI * (freq*3) * t_bck) + offset;
+      double blue  = amplitude * sin(2 * M_PI * (freq*5) * t_fwd) + offset;
+
+      // linearize perceived brightness
+      if( span ) {
+        spanFrame.set(led, lround(red * red / 255), lround(green * green / 255), lround(blue * blue / 255));
+      }
+      else {
+        frame.set(led, lround(red * red / 255), lround(green * green / 255), lround(blue * blue / 255));
+      }
+    }
+
+    if( (span ? client.send(spanFrame) : client.send(frame)) == (int)client.targets() ) {
+      sent++;
+    }
+    else {
+      failed++;
+    }
+
+    if( pacer.frames() - reported >= 10 * fps ) {
+      reported = pacer.frames();
+      printf("%.1f fps, jitter mean %.3f ms, stddev %.3f ms, max %.3f ms, %lu sent, %lu failed\n",
+        pacer.fps(), pacer.jitterMean() * 1e3, pacer.jitterStddev() * 1e3, pacer.jitterMax() * 1e3, sent, failed);
+    }
+  }
+
+  printf("%.1f fps, jitter mean %.3f ms, stddev %.3f ms, max %.3f ms, %lu sent, %lu failed\n",
+    pacer.fps(), pacer.jitterMean() * 1e3, pacer.jitterStddev() * 1e3, pacer.jitterMax() * 1e3, sent, failed);
+
+  if( receiver ) {
+    usleep(200000); // let receiver catch up
+    printf("loopback received %lu packets, %lu pixels, %lu bad\n", receiver->packets(), receiver->pixels(), receiver->bad());
+    bool ok = receiver->bad() == 0 && receiver->packets() == sent;
+    delete receiver;
+    return ok ? 0 : 2;
+  }
+
+  return 0;
+}
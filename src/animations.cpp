@@ -0,0 +1,574 @@
+#include <animations.h>
+#include <stripanim.h>
+#include <noise.h>
+
+#include <math.h>
+
+
+uint32_t mode;
+uint32_t msCircle;
+uint32_t prevMode;
+uint32_t palette;
+
+position_t positions[NUM_PIXELS];
+projection_t projections[NUM_PIXELS];
+
+vmProgram program;
+
+sparkPalette palettes[NUM_PALETTES];
+bool paletteLoaded[NUM_PALETTES];
+
+sparks_t sparkBanks[2];
+sparks_t *sparks = &sparkBanks[0];
+
+color16_t animatorColor;
+bool animatorColorSet;
+
+
+// Animation implementations
+
+// Keep the 16 bit color of an animation
+uint32_t deepColor( uint16_t r, uint16_t g, uint16_t b ) {
+  animatorColor.r = r;
+  animatorColor.g = g;
+  animatorColor.b = b;
+  animatorColorSet = true;
+  return color8(animatorColor);
+}
+
+
+// Simple all white animation
+uint32_t all_white(uint32_t t, unsigned pixel) {
+  return 0xffffff; // full bright, limitPower() keeps the current within the budget
+}
+
+
+// Simple all black animation
+uint32_t all_black(uint32_t t, unsigned pixel) {
+  return 0x000000;
+}
+
+
+// Simple all red animation
+uint32_t all_red(uint32_t t, unsigned pixel) {
+  return 0xff000f;
+}
+
+
+// Simple all yellow animation
+uint32_t all_yellow(uint32_t t, unsigned pixel) {
+  return 0xffee11;
+}
+
+
+// Simple all green animation
+uint32_t all_green(uint32_t t, unsigned pixel) {
+  return 0x00ff11;
+}
+
+
+// Simple all cyan animation
+uint32_t all_cyan(uint32_t t, unsigned pixel) {
+  return 0x00eeff;
+}
+
+
+// Simple all blue animation
+uint32_t all_blue(uint32_t t, unsigned pixel) {
+  return 0x1100ff;
+}
+
+
+// Simple all violet animation
+uint32_t all_violet(uint32_t t, unsigned pixel) {
+  return 0x8800ff;
+}
+
+
+// Builtin themes, default colors of the first palettes
+
+// Theme red-violet-blue colors
+static const baseSpark::color_t theme_red_violet_blue[] = {
+  {0xff, 0, 0},
+  {0xff, 0, 0xff},
+  {0,    0, 0xff}
+};
+
+// Theme red-green-white colors
+static const baseSpark::color_t theme_red_green_white[] = {
+  {0xff,    0,    0},
+  {0,    0xff, 0},
+  {0xff, 0xff, 0xff}
+};
+
+// Theme gold-blue-cyan-green colors
+static const baseSpark::color_t theme_gold_blue_cyan_green[] = {
+  {0xcc, 0x9b, 0x29},
+  {0,    0,    0xff},
+  {0,    0xff, 0xff},
+  {0,    0xff, 0}
+};
+
+// Theme blue-green-cyan colors
+static const baseSpark::color_t theme_green_blue_cyan[] = {
+  {0, 0,    0xff},
+  {0, 0xff, 0},
+  {0, 0xff, 0xff}
+};
+
+// Theme white colors
+static const baseSpark::color_t theme_white[] = {
+  {0, 0, 0}
+};
+
+// Theme warm colors
+static const baseSpark::color_t theme_warm[] = {
+  {0xff, 0, 0},
+  //{0,    0, 0xff},
+  {0xff, 0x0f, 0},
+  {0xff, 0x1f, 0},
+  {0xff, 0x2f, 0},
+  {0xff, 0x3f, 0},
+  {0xff, 0x4f, 0},
+  {0xff, 0x5f, 0},
+  {0xff, 0x6f, 0},
+  {0xff, 0x7f, 0},
+  {0xff, 0x8f, 0},
+  {0xff, 0x9f, 0},
+  {0xff, 0xaf, 0},
+  {0xff, 0xbf, 0},
+  {0xff, 0xcf, 0},
+  {0xff, 0xdf, 0},
+  {0xff, 0xef, 0},
+  {0xff, 0xff, 0}
+};
+
+typedef struct {
+  const baseSpark::color_t *colors;
+  size_t numColors;
+} theme_t;
+
+#define THEME(colors) { colors, sizeof(colors)/sizeof(*colors) }
+
+static const theme_t themes[] = {
+  THEME(theme_red_violet_blue),
+  THEME(theme_red_green_white),
+  THEME(theme_gold_blue_cyan_green),
+  THEME(theme_green_blue_cyan),
+  THEME(theme_white),
+  THEME(theme_warm)
+};
+
+
+// Return palette, on first use load it (see loadPalette()) or expand its builtin theme
+const sparkPalette &getPalette( unsigned index ) {
+  if( !paletteLoaded[index] ) {
+    paletteLoaded[index] = true;
+    if( !loadPalette(index, palettes[index]) ) {
+      palettes[index] = sparkPalette();
+      if( index < sizeof(themes)/sizeof(*themes) ) {
+        palettes[index].set(themes[index].colors, themes[index].numColors);
+      }
+    }
+  }
+  return palettes[index];
+}
+
+
+// Theme spark animation
+uint32_t theme_sparks(uint32_t t, unsigned pixel, unsigned paletteIndex ) {
+  themedSpark::color16_t color;
+
+  if( prevMode != mode ) {
+    sparks->themedSparks[pixel].setTheme(&getPalette(paletteIndex));
+    sparks->themedSparks[pixel].reset();
+    sparks->pixelData[pixel].spark.setSpark(&sparks->themedSparks[pixel], msCircle, t);
+  }
+
+  if( sparks->pixelData[pixel].spark.get(t, color) ) {
+    //Serial.printf("Theme 1 p0 %04x-%04x-%04x\n", color.r, color.g, color.b);
+    return deepColor(color.r, color.g, color.b);
+  }
+
+  return 0x000000;
+}
+
+
+// Theme red-violet-blue spark animation
+uint32_t theme_red_violet_blue_sparks(uint32_t t, unsigned pixel) {
+  return theme_sparks(t, pixel, 0);
+}
+
+
+// Theme red-green-white spark animation
+uint32_t theme_red_green_white_sparks(uint32_t t, unsigned pixel) {
+  return theme_sparks(t, pixel, 1);
+}
+
+
+// Theme gold-blue-cyan-green spark animation
+uint32_t theme_gold_blue_cyan_green_sparks(uint32_t t, unsigned pixel) {
+  return theme_sparks(t, pixel, 2);
+}
+
+
+// Theme blue-green-cyan spark animation
+uint32_t theme_green_blue_cyan_sparks(uint32_t t, unsigned pixel) {
+  return theme_sparks(t, pixel, 3);
+}
+
+
+// Theme white spark animation
+uint32_t theme_white_sparks(uint32_t t, unsigned pixel) {
+  return theme_sparks(t, pixel, 4);
+}
+
+
+// Theme warm spark animation
+uint32_t theme_warm_sparks(uint32_t t, unsigned pixel) {
+  return theme_sparks(t, pixel, 5);
+}
+
+
+// Spark animation with the configured palette
+uint32_t palette_sparks(uint32_t t, unsigned pixel) {
+  return theme_sparks(t, pixel, palette < NUM_PALETTES ? palette : 0);
+}
+
+
+// Random spark animation
+uint32_t random_sparks(uint32_t t, unsigned pixel) {
+  randomSpark::color16_t color;
+  if( prevMode != mode ) {
+    sparks->randomSparks[pixel].reset();
+    sparks->pixelData[pixel].spark.setSpark(&sparks->randomSparks[pixel], msCircle, t);
+  }
+  if( sparks->pixelData[pixel].spark.get(t, color) ) {
+    //Serial.printf("Random p0 %04x-%04x-%04x\n", color.r, color.g, color.b);
+    return deepColor(color.r, color.g, color.b);
+  }
+
+  return 0x000000;
+}
+
+
+// Rainbow
+uint32_t rainbow(uint32_t t, unsigned pixel) {
+  uint32_t part = t % msCircle; // time in circle
+  uint32_t segment = msCircle / 6; // size of 6 color time segments
+  uint32_t fade; // value of fading color
+
+  if( part < segment ) { // cyan -> blue
+    fade = 0xffff - (0xffffULL * part) / segment;
+    return deepColor(0, (fade*fade)>>16, 0xffff);
+  }
+  part -= segment;
+  if( part < segment ) { // blue -> violet
+    fade = (0xffffULL * part) / segment;
+    return deepColor((fade*fade)>>16, 0, 0xffff);
+  }
+  part -= segment;
+  if( part < segment ) { // violet -> red
+    fade = 0xffff - (0xffffULL * part) / segment;
+    return deepColor(0xffff, 0, (fade*fade)>>16);
+  }
+  part -= segment;
+  if( part < segment ) { // red -> yellow
+    fade = (0xffffULL * part) / segment;
+    return deepColor(0xffff, (fade*fade)>>16, 0);
+  }
+  part -= segment;
+  if( part < segment ) { // yellow -> green
+    fade = 0xffff - (0xffffULL * part) / segment;
+    return deepColor((fade*fade)>>16, 0xffff, 0);
+  }
+  part -= segment;
+  // green -> cyan
+  fade = (0xffffULL * part) / segment;
+  return deepColor(0, 0xffff, (fade*fade)>>16);
+}
+
+
+// Rainbow reversed
+uint32_t rainbow_reversed(uint32_t t, unsigned pixel) {
+  return rainbow(msCircle - 1 - t % msCircle, pixel); // time in circle, reversed
+}
+
+
+// Moving rainbow
+uint32_t rainbow_moving(uint32_t t, unsigned pixel) {
+  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
+  return rainbow((t + msOffset*pixel) % msCircle, pixel);
+}
+
+
+// Moving rainbow in reversed direction
+uint32_t rainbow_moving_reversed(uint32_t t, unsigned pixel) {
+  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
+  return rainbow_reversed((t + msOffset*pixel) % msCircle, pixel);
+}
+
+
+// Time in circle ms before t. Unlike (t - ms) % msCircle it does not wrap for t < ms,
+// so frames recorded from t = 0 for the frame cache are the same as later live frames
+static inline uint32_t circleBefore( uint32_t t, uint32_t ms ) {
+  return (t % msCircle + msCircle - ms % msCircle) % msCircle;
+}
+
+
+// Moving rainbow backwards
+uint32_t rainbow_moving_back(uint32_t t, unsigned pixel) {
+  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
+  return rainbow(circleBefore(t, msOffset*pixel), pixel);
+}
+
+
+// Moving rainbow in reversed direction backwards
+uint32_t rainbow_moving_reversed_back(uint32_t t, unsigned pixel) {
+  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
+  return rainbow_reversed(circleBefore(t, msOffset*pixel), pixel);
+}
+
+
+// Sine Wave Interferences
+
+typedef struct {
+  uint8_t amplitude;
+  uint8_t offset;
+  float frequency;
+  float phaseshift;
+} wave_t;
+
+wave_t wave_red;
+wave_t wave_green;
+wave_t wave_blue;
+
+static uint8_t amplitude_max = UINT8_MAX / 2;
+
+void sine_waves_init() {
+  wave_red.amplitude  = amplitude_max;
+  wave_red.offset     = amplitude_max;
+  wave_red.frequency  = 2.0 * M_PI / msCircle;    // frequency for one wave per looptime
+  wave_red.phaseshift = 2.0 * M_PI / NUM_PIXELS;  // phase shift between leds for one full wave
+  wave_red.phaseshift *= -1;
+
+  wave_green.amplitude  = amplitude_max;
+  wave_green.offset     = amplitude_max;
+  wave_green.frequency  = 2.0 * M_PI / msCircle;    // frequency for one wave per looptime
+  wave_green.phaseshift = 2.0 * M_PI / NUM_PIXELS;  // phase shift between leds for one full wave
+  wave_green.phaseshift *= 3;
+
+  wave_blue.amplitude  = amplitude_max;
+  wave_blue.offset     = amplitude_max;
+  wave_blue.frequency  = 2.0 * M_PI / msCircle;    // frequency for one wave per looptime
+  wave_blue.phaseshift = 2.0 * M_PI / NUM_PIXELS;  // phase shift between leds for one full wave
+  wave_blue.phaseshift *= 2;
+}
+
+// sine waves at a position along the strip (in pixels)
+uint32_t sine_waves_at(uint32_t t, float pos) {
+  uint16_t red, green, blue;
+
+  if( prevMode != mode ) {
+    sine_waves_init();
+    prevMode = mode;
+  }
+
+  t %= msCircle; // float time loses precision, keep it within the circle to repeat exactly
+
+  red   = uint16_t(wave_red.amplitude   * sin( wave_red.frequency   * t + wave_red.phaseshift   * pos )) + wave_red.offset;
+  green = uint16_t(wave_green.amplitude * sin( wave_green.frequency * t + wave_green.phaseshift * pos )) + wave_green.offset;
+  blue  = uint16_t(wave_blue.amplitude  * sin( wave_blue.frequency  * t + wave_blue.phaseshift  * pos )) + wave_blue.offset;
+
+  red   = (red   * red  ) / (2 * amplitude_max);
+  green = (green * green) / (2 * amplitude_max);
+  blue  = (blue  * blue ) / (2 * amplitude_max);
+
+  uint32_t col = (red & 0xff) << 16 | (green & 0xff) << 8 | (blue & 0xff);
+  return col;
+}
+
+// sine waves animation, without floats for the known strip length
+uint32_t sine_waves(uint32_t t, unsigned pixel) {
+  return stripSineWaves<NUM_PIXELS>(t, pixel, msCircle);
+}
+
+
+// Spatial animations, using the pixel map projections
+
+// Time offset in a circle for a projection fraction
+static inline uint32_t circleOffset( uint16_t fraction ) {
+  return ((uint64_t)msCircle * fraction) >> 16;
+}
+
+
+// Rainbow rising through the pixel map (planes)
+uint32_t rainbow_rising(uint32_t t, unsigned pixel) {
+  return rainbow(circleBefore(t, circleOffset(projections[pixel].height)), pixel);
+}
+
+
+// Rainbow spheres growing from the center of the pixel map
+uint32_t rainbow_spheres(uint32_t t, unsigned pixel) {
+  return rainbow(circleBefore(t, circleOffset(projections[pixel].radius)), pixel);
+}
+
+
+// Rainbow spiral turning around the vertical axis of the pixel map
+uint32_t rainbow_spiral(uint32_t t, unsigned pixel) {
+  uint16_t turn = projections[pixel].angle + projections[pixel].height;
+  return rainbow(circleBefore(t, circleOffset(turn)), pixel);
+}
+
+
+// Sine waves by height in the pixel map
+uint32_t sine_waves_height(uint32_t t, unsigned pixel) {
+  return sine_waves_at(t, projections[pixel].height * (NUM_PIXELS / 65536.0f));
+}
+
+
+// Custom animation: the uploaded program evaluated for each pixel
+uint32_t custom_program(uint32_t t, unsigned pixel) {
+  static vmInputs_t in;
+
+  if( prevMode != mode ) {
+    program.setPalette(&getPalette(palette < NUM_PALETTES ? palette : 0));
+  }
+
+  in.t = t;
+  in.circle = msCircle;
+  in.phase = ((uint64_t)(t % msCircle) << 16) / msCircle;
+  in.pixel = pixel;
+  in.pixels = NUM_PIXELS;
+  in.x = positions[pixel].x;
+  in.y = positions[pixel].y;
+  in.z = positions[pixel].z;
+  in.height = projections[pixel].height;
+  in.radius = projections[pixel].radius;
+  in.angle = projections[pixel].angle;
+  return program.run(in);
+}
+
+
+// Noise animations: coordinates have 8 fraction bits, 256 is one noise cell
+
+// Noise cells an animation moves per circle
+static inline uint32_t noiseScroll( uint32_t t, unsigned cellsPerCircle ) {
+  return ((uint64_t)t * cellsPerCircle * 256) / msCircle;
+}
+
+
+// Fire rising from the bottom of the pixel map
+uint32_t fire(uint32_t t, unsigned pixel) {
+  static noiseLine flames;
+
+  uint16_t height = projections[pixel].height;
+  int32_t x = (height >> 6) - noiseScroll(t, 32); // strip spans 4 cells
+  int32_t heat = 160 + (flames.get(x, 0, noiseScroll(t, 8)) >> 7) - (height >> 8);
+  heat = heat < 0 ? 0 : (heat > 255 ? 255 : heat);
+
+  // black - red - yellow - white
+  uint32_t heat3 = heat * 3;
+  uint32_t red = heat3 > 255 ? 255 : heat3;
+  uint32_t green = heat3 > 510 ? 255 : (heat3 > 255 ? heat3 - 255 : 0);
+  uint32_t blue = heat3 > 510 ? heat3 - 510 : 0;
+  return red << 16 | green << 8 | blue;
+}
+
+
+// Snow flakes falling through the pixel map
+uint32_t snow(uint32_t t, unsigned pixel) {
+  static noiseLine flakes;
+
+  int32_t x = (projections[pixel].height >> 4) + noiseScroll(t, 16); // strip spans 16 cells
+  int32_t flake = flakes.get(x, 0, noiseScroll(t, 4)) - 12000;
+  if( flake <= 0 ) {
+    return 0x000000;
+  }
+  uint32_t white = flake >= 20767 ? 255 : (flake * 255) / 20767;
+  return (white * 3 / 4) << 16 | (white * 7 / 8) << 8 | white;
+}
+
+
+// Pixels twinkling independently in colors of the configured palette
+uint32_t twinkle(uint32_t t, unsigned pixel) {
+  int32_t level = noise2(pixel * 256 + 128, noiseScroll(t, 16)) >> 7;
+  if( level <= 0 ) {
+    return 0x000000;
+  }
+  level = (level * level) >> 8;
+
+  const baseSpark::color_t &color = getPalette(palette < NUM_PALETTES ? palette : 0).get(pixel * 97);
+  return ((color.r * level) >> 8) << 16 | ((color.g * level) >> 8) << 8 | ((color.b * level) >> 8);
+}
+
+
+// Strip test: black, red, green, blue and black again fill the strip one after the other,
+// in alternating directions. Each color takes a fifth of the circle
+uint32_t self_test(uint32_t t, unsigned pixel) {
+  static const uint32_t colors[] = { 0x000000, 0xff0000, 0x00ff00, 0x0000ff, 0x000000 };
+  const uint32_t num = sizeof(colors)/sizeof(*colors);
+  uint32_t part = t % msCircle; // time in circle
+  uint32_t segment = msCircle / num + 1; // time of one color
+  uint32_t color = part / segment;
+  uint32_t filled = ((part % segment) * NUM_PIXELS) / segment; // pixels in new color
+
+  unsigned index = (color & 1) ? NUM_PIXELS - 1 - pixel : pixel;
+  return index < filled ? colors[color] : colors[(color + num - 1) % num];
+}
+
+
+// List of animation functions defined above
+animator_t animators[NUM_MODES] = {
+  // First entry is default (make it a nice one...)
+  sine_waves,
+  theme_red_violet_blue_sparks,
+  theme_red_green_white_sparks,
+  theme_gold_blue_cyan_green_sparks,
+  theme_green_blue_cyan_sparks,
+  theme_warm_sparks,
+  random_sparks,
+  theme_white_sparks,
+  rainbow,
+  rainbow_reversed,
+  rainbow_moving,
+  rainbow_moving_reversed,
+  rainbow_moving_back,
+  rainbow_moving_reversed_back,
+  all_red,
+  all_yellow,
+  all_green,
+  all_cyan,
+  all_blue,
+  all_violet,
+  all_white,
+  all_black,
+  replay,
+  palette_sparks,
+  rainbow_rising,
+  rainbow_spheres,
+  rainbow_spiral,
+  sine_waves_height,
+  custom_program,
+  fire,
+  snow,
+  twinkle,
+  self_test
+};
+
+
+// Periodic animators, for the frame cache
+bool isPeriodic( animator_t anim ) {
+  static const animator_t periodic[] = {
+    sine_waves,
+    self_test,
+    sine_waves_height
+  };
+
+  for( size_t i = 0; i < sizeof(periodic)/sizeof(*periodic); i++ ) {
+    if( periodic[i] == anim ) {
+      return true;
+    }
+  }
+  return false;
+}
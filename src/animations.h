@@ -0,0 +1,80 @@
+#ifndef _animations_h
+#define _animations_h
+
+#include <stdint.h>
+#include <spark.h>
+#include <pixelmap.h>
+#include <vm.h>
+#include <deepcolor.h>
+
+// Animations of the strip. An animator returns the color 0xRRGGBB of a pixel at time t (ms).
+// Besides replay() and palettes from flash they have no hardware dependencies,
+// so host tools can render them with a fixed clock and seed.
+
+// Neopixels to use
+#ifndef NUM_PIXELS
+#define NUM_PIXELS       50
+#endif
+
+// Theme colors for sparks, the first ones default to the builtin themes
+#define NUM_PALETTES      8
+
+// Entries of animators[]
+#define NUM_MODES        33
+
+// Animation data
+typedef struct {
+    timedSpark spark;
+} animation_t;
+
+// Spark state of all pixels. There are two banks of it,
+// so the outgoing animation of a crossfade keeps its sparks
+typedef struct {
+  animation_t pixelData[NUM_PIXELS]; // animation data of each pixel
+  themedSpark themedSparks[NUM_PIXELS];
+  randomSpark randomSparks[NUM_PIXELS];
+} sparks_t;
+
+// Animation function
+typedef uint32_t (*animator_t)(uint32_t t, unsigned pixel);
+
+extern uint32_t mode;                     // current animation (index to animators[])
+extern uint32_t msCircle;                 // min ms for an animation circle
+extern uint32_t prevMode;                 // previous loop animation, animators init if it differs
+extern uint32_t palette;                  // palette of palette sparks
+
+extern position_t positions[NUM_PIXELS];       // pixel map, see setupPixelMap()
+extern projection_t projections[NUM_PIXELS];   // precomputed from positions for spatial animations
+
+extern vmProgram program;                 // compiled custom animation
+
+extern sparkPalette palettes[NUM_PALETTES]; // theme colors for sparks
+extern bool paletteLoaded[NUM_PALETTES];  // palette expanded, see getPalette()
+
+extern sparks_t sparkBanks[2];
+extern sparks_t *sparks;                  // spark state of current animation
+
+// Animations computing more than 8 bits per channel leave their color here for the
+// 16 bit frame, colors of the others are expanded from 8 bits. See deepColor()
+extern color16_t animatorColor;
+extern bool animatorColorSet;
+
+extern animator_t animators[NUM_MODES];
+
+// Keep the 16 bit color of an animation and return it as 0xRRGGBB
+uint32_t deepColor( uint16_t r, uint16_t g, uint16_t b );
+
+// Return palette, on first use load it (see loadPalette()) or expand its builtin theme
+const sparkPalette &getPalette( unsigned index );
+
+// Animations that repeat exactly after msCircle and can be played from the frame cache.
+// The rainbows repeat too, but their 16 bit colors don't fit the 8 bit cache
+bool isPeriodic( animator_t anim );
+
+// Provided by the application: load an uploaded palette, false if there is none
+bool loadPalette( unsigned index, sparkPalette &palette );
+
+// Provided by the application: replay of a recorded UDP show
+uint32_t replay( uint32_t t, unsigned pixel );
+
+#endif
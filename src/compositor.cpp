@@ -0,0 +1,126 @@
+#include <compositor.h>
+
+
+void blendSpan( uint32_t frame[], const uint32_t layer[], uint16_t count, uint8_t blend, uint8_t alpha ) {
+  switch( blend ) {
+    case BLEND_ALPHA: {
+      // Red and blue are blended together in one multiplication, green in another
+      uint32_t a = alpha + (alpha >> 7); // 0-256
+      for( uint16_t i = 0; i < count; i++ ) {
+        uint32_t l = layer[i];
+        uint32_t f = frame[i];
+        uint32_t rb = (((l & 0xff00ff) * a + (f & 0xff00ff) * (256 - a)) >> 8) & 0xff00ff;
+        uint32_t g  = (((l & 0x00ff00) * a + (f & 0x00ff00) * (256 - a)) >> 8) & 0x00ff00;
+        frame[i] = rb | g;
+      }
+      break;
+    }
+
+    case BLEND_ADD:
+      // Add all channels at once: sum of the low 7 bits, then the top bits without carry
+      for( uint16_t i = 0; i < count; i++ ) {
+        uint32_t l = layer[i];
+        uint32_t f = frame[i];
+        uint32_t sum = ((l & 0x7f7f7f) + (f & 0x7f7f7f)) ^ ((l ^ f) & 0x808080);
+        uint32_t carry = ((l & f) | ((l | f) & ~sum)) & 0x808080; // channels that overflowed
+        frame[i] = sum | ((carry >> 7) * 0xff);                   // saturate them
+      }
+      break;
+
+    default: // BLEND_REPLACE
+      for( uint16_t i = 0; i < count; i++ ) {
+        frame[i] = layer[i];
+      }
+  }
+}
+
+
+void spanSet::add( uint16_t start, uint16_t count ) {
+  if( count == 0 ) {
+    return;
+  }
+  uint16_t end = start + count;
+
+  // Find first span not ending before the new one
+  uint8_t i = 0;
+  while( i < _num && _spans[i].end < start ) {
+    i++;
+  }
+
+  if( i < _num && _spans[i].start <= end ) {
+    // Touches span i: extend it and swallow following spans it now reaches
+    if( start < _spans[i].start ) {
+      _spans[i].start = start;
+    }
+    if( end > _spans[i].end ) {
+      _spans[i].end = end;
+    }
+    uint8_t j = i + 1;
+    while( j < _num && _spans[j].start <= _spans[i].end ) {
+      if( _spans[j].end > _spans[i].end ) {
+        _spans[i].end = _spans[j].end;
+      }
+      j++;
+    }
+    for( uint8_t k = j; k < _num; k++ ) {
+      _spans[i + 1 + k - j] = _spans[k];
+    }
+    _num -= j - i - 1;
+    return;
+  }
+
+  if( _num == MAX_SPANS ) {
+    // Full: merge the two spans with the smallest gap to make room
+    uint8_t best = 0;
+    for( uint8_t k = 1; k + 1 < _num; k++ ) {
+      if( _spans[k + 1].start - _spans[k].end < _spans[best + 1].start - _spans[best].end ) {
+        best = k;
+      }
+    }
+    _spans[best].end = _spans[best + 1].end;
+    for( uint8_t k = best + 1; k + 1 < _num; k++ ) {
+      _spans[k] = _spans[k + 1];
+    }
+    _num--;
+    if( i == best + 1 ) {
+      return; // new span was in the merged gap
+    }
+    if( i > best ) {
+      i--;
+    }
+  }
+
+  // Insert new span before span i
+  for( uint8_t k = _num; k > i; k-- ) {
+    _spans[k] = _spans[k - 1];
+  }
+  _spans[i].start = start;
+  _spans[i].end = end;
+  _num++;
+}
+
+
+uint32_t diffFrame( uint32_t prev[], const uint32_t next[], uint16_t count, spanSet &dirty ) {
+  uint32_t hash = 2166136261UL;
+  uint16_t i = 0;
+  while( i < count ) {
+    // Skip equal words
+    while( i < count && prev[i] == next[i] ) {
+      hash = (hash ^ next[i]) * 16777619UL;
+      i++;
+    }
+    if( i == count ) {
+      break;
+    }
+
+    // Copy a range of changed words
+    uint16_t start = i;
+    while( i < count && prev[i] != next[i] ) {
+      prev[i] = next[i];
+      hash = (hash ^ next[i]) * 16777619UL;
+      i++;
+    }
+    dirty.add(start, i - start);
+  }
+  return hash;
+}
@@ -0,0 +1,48 @@
+#ifndef _compositor_h
+#define _compositor_h
+
+#include <stdint.h>
+
+// Blend modes of a layer onto the layers below
+#define BLEND_REPLACE 0  // layer colors replace frame colors
+#define BLEND_ALPHA   1  // mix layer and frame colors by alpha (0-255)
+#define BLEND_ADD     2  // add layer to frame colors, saturating at 0xff
+#define BLEND_MODES   3
+
+// Blend count layer colors onto frame colors (both 0xRRGGBB)
+void blendSpan( uint32_t frame[], const uint32_t layer[], uint16_t count, uint8_t blend, uint8_t alpha );
+
+
+// Pixel ranges touched by a layer, so blending only processes those.
+// Touching more than MAX_SPANS separate ranges merges the closest ones
+class spanSet {
+public:
+  static const uint8_t MAX_SPANS = 8;
+
+  spanSet() : _num(0) {}
+
+  void clear() { _num = 0; }
+  bool empty() const { return _num == 0; }
+
+  // Add pixels start to start+count-1
+  void add( uint16_t start, uint16_t count = 1 );
+
+  // Call f(start, count) for each range in ascending order
+  template<typename F> void each( F f ) const {
+    for( uint8_t i = 0; i < _num; i++ ) {
+      f(_spans[i].start, _spans[i].end - _spans[i].start);
+    }
+  }
+
+private:
+  struct { uint16_t start, end; } _spans[MAX_SPANS]; // sorted, not touching
+  uint8_t _num;
+};
+
+
+// Compare a new frame with the previous one word by word (0xRRGGBB each).
+// Adds the ranges of changed pixels to dirty and copies them to prev, so prev equals next afterwards.
+// Returns a hash (FNV-1a of the words) of the new frame
+uint32_t diffFrame( uint32_t prev[], const uint32_t next[], uint16_t count, spanSet &dirty );
+
+#endif
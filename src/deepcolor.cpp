@@ -0,0 +1,52 @@
+#include <deepcolor.h>
+
+
+void expandSpan( color16_t frame[], const uint32_t colors[], uint16_t count ) {
+  for( uint16_t i = 0; i < count; i++ ) {
+    frame[i] = color16(colors[i]);
+  }
+}
+
+
+uint32_t scaleSpan16( color16_t frame[], const color16_t src[], uint16_t count, uint32_t scale ) {
+  uint32_t channels = 0;
+  for( uint16_t i = 0; i < count; i++ ) {
+    frame[i].r = (src[i].r * scale) >> 8;
+    frame[i].g = (src[i].g * scale) >> 8;
+    frame[i].b = (src[i].b * scale) >> 8;
+    channels += frame[i].r + frame[i].g + frame[i].b;
+  }
+  return channels;
+}
+
+
+// Add the error of the previous frame, return value/257 (0xffff -> 0xff) and keep the remainder
+// as new error. Colors expanded from 8 bits leave no remainder, so they do not flicker.
+// x*0xff01>>24 is x/257 for all 16 bit x, the remainder 256 is stored as 255
+static inline uint32_t ditherChannel( uint32_t value, uint8_t &error ) {
+  value += error;
+  if( value > 0xffff ) {
+    value = 0xffff;
+  }
+  uint32_t color = (value * 0xff01) >> 24;
+  uint32_t rest = value - color * 257;
+  error = rest > 0xff ? 0xff : rest;
+  return color;
+}
+
+
+void ditherSpan( const color16_t frame[], uint8_t error[], uint32_t colors[], uint16_t count, uint32_t scale ) {
+  if( !error ) {
+    for( uint16_t i = 0; i < count; i++ ) {
+      colors[i] = ((frame[i].r * scale) >> 24) << 16 | ((frame[i].g * scale) >> 24) << 8 | ((frame[i].b * scale) >> 24);
+    }
+    return;
+  }
+
+  for( uint16_t i = 0; i < count; i++, error += 3 ) {
+    uint32_t r = ditherChannel((frame[i].r * scale) >> 16, error[0]);
+    uint32_t g = ditherChannel((frame[i].g * scale) >> 16, error[1]);
+    uint32_t b = ditherChannel((frame[i].b * scale) >> 16, error[2]);
+    colors[i] = r << 16 | g << 8 | b;
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef _deepcolor_h
+#define _deepcolor_h
+
+#include <stdint.h>
+
+// Color with 16 bits per channel, keeps the low bits of fades and brightness scaling
+typedef struct {
+  uint16_t r, g, b;
+} color16_t;
+
+// Expand 0xRRGGBB (0xff becomes 0xffff)
+static inline color16_t color16( uint32_t color ) {
+  color16_t c = {
+    (uint16_t)(((color >> 16) & 0xff) * 0x101),
+    (uint16_t)(((color >> 8) & 0xff) * 0x101),
+    (uint16_t)((color & 0xff) * 0x101) };
+  return c;
+}
+
+// Reduce to 0xRRGGBB, dropping the low bits
+static inline uint32_t color8( const color16_t &color ) {
+  return (uint32_t)(color.r >> 8) << 16 | (color.g >> 8) << 8 | color.b >> 8;
+}
+
+// Expand count colors 0xRRGGBB into frame
+void expandSpan( color16_t frame[], const uint32_t colors[], uint16_t count );
+
+// Scale count colors from src into frame by scale/256 (0-256). Returns the sum of all channels
+uint32_t scaleSpan16( color16_t frame[], const color16_t src[], uint16_t count, uint32_t scale );
+
+// Reduce count colors to 0xRRGGBB after scaling them by scale/65536 (0-65536).
+// Temporal dithering: with error (3 bytes per pixel) each channel carries its rounding error
+// into the next frame, so the average of frames shows the low bits. Without error, low bits are dropped
+void ditherSpan( const color16_t frame[], uint8_t error[], uint32_t colors[], uint16_t count, uint32_t scale );
+
+#endif
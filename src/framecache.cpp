@@ -0,0 +1,87 @@
+#include <framecache.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+
+frameCache::frameCache() : _data(0), _offsets(0), _capacity(0), _used(0), _numFrames(0), _added(0), _numPixels(0) {
+}
+
+frameCache::~frameCache() {
+  end();
+}
+
+bool frameCache::begin( uint32_t numFrames, uint16_t numPixels, size_t budget ) {
+  end();
+
+  size_t offsetSize = numFrames * sizeof(*_offsets);
+  if( numFrames == 0 || offsetSize + 4 * numPixels > budget ) {
+    return false;
+  }
+
+  _capacity = budget - offsetSize;
+  if( _capacity > 0x10000 ) {
+    _capacity = 0x10000; // offsets are 16 bit
+  }
+
+  _offsets = (uint16_t *)malloc(offsetSize);
+  _data = (uint8_t *)malloc(_capacity);
+  if( !_offsets || !_data ) {
+    end();
+    return false;
+  }
+
+  _numFrames = numFrames;
+  _numPixels = numPixels;
+  _added = 0;
+  _used = 0;
+  return true;
+}
+
+bool frameCache::add( const uint32_t colors[] ) {
+  if( !recording() ) {
+    return false;
+  }
+
+  // Encode behind the used data
+  size_t start = _used;
+  size_t pos = start;
+  uint16_t pixel = 0;
+  while( pixel < _numPixels ) {
+    uint32_t color = colors[pixel];
+    uint8_t count = 1;
+    while( ++pixel < _numPixels && colors[pixel] == color && count < 0xff ) {
+      count++;
+    }
+    if( pos + 4 > _capacity ) {
+      end();
+      return false;
+    }
+    _data[pos++] = count;
+    _data[pos++] = color >> 16;
+    _data[pos++] = color >> 8;
+    _data[pos++] = color;
+  }
+
+  if( _added ) {
+    // Reuse previous frame if identical
+    uint16_t prev = _offsets[_added - 1];
+    if( start - prev == pos - start && memcmp(_data + prev, _data + start, pos - start) == 0 ) {
+      _offsets[_added++] = prev;
+      return true;
+    }
+  }
+
+  _offsets[_added++] = start;
+  _used = pos;
+  return true;
+}
+
+void frameCache::end() {
+  free(_data);
+  free(_offsets);
+  _data = 0;
+  _offsets = 0;
+  _capacity = _used = 0;
+  _numFrames = _added = 0;
+}
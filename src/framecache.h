@@ -0,0 +1,60 @@
+#ifndef _framecache_h
+#define _framecache_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Stores the frames of one period of an animation run length encoded in RAM.
+// Each frame is a sequence of runs: count (1-255) followed by r, g and b.
+// A frame identical to its predecessor takes no space besides its offset.
+class frameCache {
+public:
+  frameCache();
+  ~frameCache();
+
+  // Prepare for numFrames frames of numPixels, using at most budget bytes.
+  // Returns false if even the frame offsets don't fit.
+  bool begin( uint32_t numFrames, uint16_t numPixels, size_t budget );
+
+  // Append the next frame (colors as 0xRRGGBB).
+  // Returns false and frees the cache if the budget is exceeded
+  bool add( const uint32_t colors[] );
+
+  // Free all memory
+  void end();
+
+  // All frames added and ready for playback?
+  bool ready() const { return _data && _added == _numFrames; }
+
+  // Frames not yet added
+  bool recording() const { return _data && _added < _numFrames; }
+
+  uint32_t frames() const { return _numFrames; }
+  uint32_t added() const { return _added; }
+  size_t size() const { return _numFrames * sizeof(*_offsets) + _used; }
+
+  // Call set(pixel, r, g, b) for each pixel of the frame
+  template<typename F> void get( uint32_t frame, F set ) const {
+    const uint8_t *run = _data + _offsets[frame];
+    uint16_t pixel = 0;
+    while( pixel < _numPixels ) {
+      for( uint8_t count = run[0]; count; count-- ) {
+        set(pixel++, run[1], run[2], run[3]);
+      }
+      run += 4;
+    }
+  }
+
+private:
+  frameCache( const frameCache & );
+
+  uint8_t  *_data;      // encoded frames
+  uint16_t *_offsets;   // start of each frame in _data
+  size_t    _capacity;  // bytes available for _data
+  size_t    _used;      // bytes used in _data
+  uint32_t  _numFrames;
+  uint32_t  _added;
+  uint16_t  _numPixels;
+};
+
+#endif
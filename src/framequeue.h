@@ -0,0 +1,65 @@
+#ifndef _framequeue_h
+#define _framequeue_h
+
+#include <stdint.h>
+#include <atomic>
+
+// Alignment of the queue indexes. Hosts with caches use their line size (e.g. 64)
+// so producer and consumer do not invalidate each others index
+#ifndef FRAMEQUEUE_ALIGN
+#define FRAMEQUEUE_ALIGN 4
+#endif
+
+// Lock-free queue of N frames between one producer and one consumer (N a power of 2).
+// Frames are filled and read in place: the producer fills write() and commits it with push(),
+// the consumer reads front() and releases it with pop(). Each index is written by one side only,
+// release/acquire ordering makes the frame contents visible together with the index.
+template <typename T, uint32_t N>
+class frameQueue {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "frameQueue size must be a power of 2");
+
+public:
+  frameQueue() : _head(0), _tail(0) {}
+
+  // Producer: slot to fill or 0 if all slots are queued
+  T *write() {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if( head - _tail.load(std::memory_order_acquire) == N ) {
+      return 0;
+    }
+    return &_slots[head & (N - 1)];
+  }
+
+  // Producer: queue the slot filled via write()
+  void push() {
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Consumer: oldest queued frame or 0 if empty
+  T *front() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if( _head.load(std::memory_order_acquire) == tail ) {
+      return 0;
+    }
+    return &_slots[tail & (N - 1)];
+  }
+
+  // Consumer: release the frame from front()
+  void pop() {
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Queued frames, exact only on either side
+  uint32_t size() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  static uint32_t capacity() { return N; }
+
+private:
+  T _slots[N];
+  alignas(FRAMEQUEUE_ALIGN) std::atomic<uint32_t> _head;  // next slot to fill, only changed by producer
+  alignas(FRAMEQUEUE_ALIGN) std::atomic<uint32_t> _tail;  // next slot to read, only changed by consumer
+};
+
+#endif
@@ -3,6 +3,15 @@
 // Strip and animation
 #include <NeoPixelBus.h>
 #include <spark.h>
+#include <framecache.h>
+#include <compositor.h>
+#include <pixelmap.h>
+#include <vm.h>
+#include <noise.h>
+#include <framequeue.h>
+#include <deepcolor.h>
+#include <stripanim.h>
+#include <animations.h>
 
 // Web Updater
 #include <ESP8266WiFi.h>
@@ -18,6 +27,11 @@
 
 // UDP Strip Control
 #include <WiFiUdp.h>
+#include <lwip/igmp.h>
+#include <nxproto.h>
+
+// Recorded UDP shows
+#include <LittleFS.h>
 
 // Network stuff, might already be defined by the build tools
 #ifdef WLANCONFIG
@@ -51,437 +65,558 @@ Logger logger(SYSLOG_SERVER, SYSLOG_APP, SYSLOG_PRIO);
 ADC_MODE(ADC_VCC);
 
 #define ONLINE_LED_PIN D4
-#define UDP_PORT         (('N' << 8) | 'X')
-
-// Neopixels to use
-#define NUM_PIXELS       50
+#define UDP_PORT         NX_PORT
+
+// Strips driven in parallel: DMA on RX0/GPIO3 and, if UART_OUTPUT is defined,
+// UART1 on GPIO2/D4 (instead of the online led). Logical pixels are mapped onto them
+#ifdef UART_OUTPUT
+  #define NUM_OUTPUTS     2
+#else
+  #define NUM_OUTPUTS     1
+#endif
+#define DMA_PIXELS       NUM_PIXELS
+#define UART_PIXELS      NUM_PIXELS
+// Ranges of logical pixels mapped to outputs
+#define MAX_MAPPINGS      4
 
 // Update interval. Increase, if you want to save time for other stuff...
 #define INTERVAL_MS       4
 // Min and max/2 time for one full animation circle of a led
 #define CIRCLE_MS     10000
+// Max RAM for caching the frames of one animation circle
+#define CACHE_BUDGET  12288
+// Longest circle that can fit: a 16 bit offset and at least one run of 4 bytes per frame
+#define CACHE_CIRCLE_MS (CACHE_BUDGET / (2 + 4) * INTERVAL_MS)
+// Animations on pixel ranges composed over the main animation
+#define MAX_SEGMENTS      4
+// Frames rendered ahead of the strip (power of 2)
+#define FRAME_QUEUE       4
+// Default current budget of the strip power supply (0: unlimited)
+#define MILLIAMPS      2000
+// Estimated current of a pixel: idle and per color channel at full brightness
+#define PIXEL_IDLE_MA     1
+#define CHANNEL_MA       20
+// Time to connect with the cached Wifi channel and access point before scanning again
+#define WIFI_CACHED_MS 5000
 
 // Change, if you modify eeprom_t in a backward incompatible way
-#define EEPROM_MAGIC     (0xabcd1236)
+#define EEPROM_MAGIC     (0xabcd1241)
 
-// EEPROM data
+// Animation on a range of pixels, composed over the main animation
 typedef struct {
-  uint32_t mode;      // blink/animation mode
-  uint32_t msCircle;  // min ms for an animation circle
-  uint32_t magic;     // verify eeprom data is ours
-} eeprom_t;
-
-// Animation data
+  uint32_t mode;       // index to animators[]
+  uint32_t prevMode;   // animation of previous frame (differs to init)
+  uint16_t start;      // first pixel
+  uint16_t count;      // number of pixels, 0: segment unused
+  uint8_t  blend;      // BLEND_* onto main animation
+  uint8_t  alpha;      // for BLEND_ALPHA
+} segment_t;
+
+// Range of logical pixels shown on an output strip
 typedef struct {
-    timedSpark spark;
-} animation_t;
+  uint16_t start;      // first logical pixel
+  uint16_t count;      // number of pixels, 0: mapping unused
+  uint16_t offset;     // first pixel on the output
+  uint8_t  output;     // output strip
+  uint8_t  reversed;   // 1: first logical pixel at offset + count - 1
+} mapping_t;
 
-// Animation function
-typedef uint32_t (*animator_t)(uint32_t t, unsigned pixel);
-
-uint32_t mode;                     // current animation (index to animators[])
-uint32_t msCircle;                 // min ms for an animation circle
-uint32_t prevMode;                 // previous loop animation
-bool     paused;                   // Animation paused?
+// EEPROM data
+typedef struct {
+  uint32_t mode;       // blink/animation mode
+  uint32_t msCircle;   // min ms for an animation circle
+  uint32_t brightness; // scales all pixel colors (0-255)
+  uint32_t seed;       // spark random seed (0: not reproducible)
+  uint32_t cache;      // play periodic animations from frame cache (0: off)
+  uint32_t overlay;    // UDP pixels: 0 take over strip, else BLEND_* + 1 onto animation
+  uint32_t overlayAlpha; // for overlay BLEND_ALPHA
+  uint32_t fade;       // ms to crossfade between modes
+  uint32_t palette;    // palette of palette sparks
+  uint32_t milliamps;  // current budget of the strip (0: unlimited)
+  uint32_t dither;     // temporal dithering of 16 bit frames (0: off)
+  uint32_t group;      // multicast group for span packets (IPv4, 0: none)
+  uint32_t slice;      // first pixel of the strip in the shared pixel space of span packets
+  uint32_t wifiChannel; // Wifi channel of the last connection (0: unknown)
+  uint8_t  wifiBssid[6]; // access point of the last connection
+  segment_t segments[MAX_SEGMENTS];
+  mapping_t mappings[MAX_MAPPINGS];
+  uint32_t magic;      // verify eeprom data is ours
+} eeprom_t;
 
+// Recorded UDP show: SHOW_MAGIC followed by one record per UDP packet.
+// Record header is ms since previous packet and length of pixel blocks following (both little endian)
+#define SHOW_FILE          "/show.nx"
+#define SHOW_MAGIC         "NXS1"
 
-animation_t pixelData[NUM_PIXELS]; // animation data of each pixel
-themedSpark themedSparks[NUM_PIXELS];
-randomSpark randomSparks[NUM_PIXELS];
+// Uploaded pixel map: position_t of each pixel
+#define MAP_FILE           "/pixelmap"
 
-NeoPixelBus<NeoRgbFeature, Neo800KbpsMethod> pixels(NUM_PIXELS);  // ESP8266: uses RX0/GPIO3 for DMA
+// Uploaded program source for the custom animation
+#define PROGRAM_FILE       "/program"
 
-ESP8266WebServer web_server(PORT);
+typedef struct {
+  uint16_t ms;         // time since previous record
+  uint16_t length;     // bytes of pixel blocks following
+} record_t;
 
-ESP8266HTTPUpdateServer esp_updater;
+// Rendered frame, queued for the strip
+typedef struct {
+  uint32_t t;                   // animation time
+  uint32_t hash;                // of colors, see diffFrame()
+  spanSet dirty;                // pixels changed since the previous queued frame
+  uint32_t colors[NUM_PIXELS];  // pixel colors 0xRRGGBB with brightness applied
+} frame_t;
+
+uint32_t brightness;               // scales all pixel colors (0-255)
+uint32_t seed;                     // spark random seed (0: not reproducible)
+uint32_t cache;                    // play periodic animations from frame cache (0: off)
+uint32_t overlay;                  // UDP pixels: 0 take over strip, else BLEND_* + 1 onto animation
+uint32_t overlayAlpha;             // for overlay BLEND_ALPHA
+uint32_t fade;                     // ms to crossfade between modes
+uint32_t milliamps;                // current budget of the strip (0: unlimited)
+uint32_t dither;                   // temporal dithering of 16 bit frames (0: off)
+uint32_t group;                    // multicast group for span packets (IPv4, 0: none)
+uint32_t slice;                    // first pixel of the strip in the shared pixel space of span packets
+segment_t segments[MAX_SEGMENTS];  // animations on pixel ranges
+mapping_t mappings[MAX_MAPPINGS];  // logical pixels on output strips
+bool     remapped;                 // mappings changed, clear outputs
+bool     paused;                   // Animation paused?
 
-WiFiUDP udpSocket;
+sparks_t segmentSparks[MAX_SEGMENTS]; // spark state of each segment, crossfades of the main animation don't swap it
 
+segment_t fadeFrom;                // outgoing animation while crossfading (count 0: not fading)
+sparks_t *fadeSparks;              // spark state of outgoing animation
+uint32_t fadeStart;                // time of first crossfade frame
+uint32_t fadeFrames;               // frames rendered while crossfading
 
-// Animation implementations
+frameCache frames;                 // one circle of the current animation, if periodic
 
-// Simple all white animation
-uint32_t all_white(uint32_t t, unsigned pixel) {
-  return 0xffffff; // 0xaaaaaa: no full bright for current reduction
-}
+// Color feature of the strips and its byte order, frames are written directly into their buffers
+template<typename F> struct featureOrder;
+template<> struct featureOrder<NeoRgbFeature> { typedef orderRgb type; };
+template<> struct featureOrder<NeoGrbFeature> { typedef orderGrb type; };
 
+typedef NeoRgbFeature pixelFeature;
+typedef featureOrder<pixelFeature>::type pixelOrder;
+static_assert(pixelFeature::PixelSize == 3, "strip buffers need 3 bytes per pixel");
 
-// Simple all black animation
-uint32_t all_black(uint32_t t, unsigned pixel) {
-  return 0x000000;
-}
+NeoPixelBus<pixelFeature, Neo800KbpsMethod> pixels(DMA_PIXELS);  // ESP8266: uses RX0/GPIO3 for DMA
+#ifdef UART_OUTPUT
+NeoPixelBus<pixelFeature, NeoEsp8266AsyncUart1800KbpsMethod> uartPixels(UART_PIXELS);  // GPIO2, sends in background
+#endif
 
+frameQueue<frame_t, FRAME_QUEUE> queue;  // from network and rendering to the strip
+uint32_t framesQueued;             // frames rendered into the queue
+uint32_t framesShown;              // frames sent to the strip
+uint32_t framesSkipped;            // changed frames not queued, because the strip was behind
+uint32_t framesUnchanged;          // rendered frames equal to the previous one
+uint32_t frameLagMax;              // max ms between rendering and showing a frame
+uint32_t frameHash;                // hash of the frame shown last
+uint32_t frameMilliamps;           // estimated current of the latest frame
+uint32_t frameMilliampsMax;        // max estimated current since last monitor()
+uint32_t framesLimited;            // frames scaled down to the current budget
+
+uint32_t wifiChannel;              // Wifi channel of the last connection (0: unknown)
+uint8_t  wifiBssid[6];             // access point of the last connection
+bool     wifiCached;               // connecting with cached channel and access point only
+uint32_t msWifiDown;               // time Wifi was started or lost
+uint32_t msFirstFrame;             // boot time until the first frame was shown
+uint32_t msNetwork;                // boot time until Wifi was connected
 
-// Simple all red animation
-uint32_t all_red(uint32_t t, unsigned pixel) {
-  return 0xff000f;
-}
-
+ESP8266WebServer web_server(PORT);
 
-// Simple all yellow animation
-uint32_t all_yellow(uint32_t t, unsigned pixel) {
-  return 0xffee11;
-}
+ESP8266HTTPUpdateServer esp_updater;
 
+WiFiUDP udpSocket;
+IPAddress udpInterface;            // interface and multicast group joined by udpBegin(), if any
+IPAddress udpGroup;
 
-// Simple all green animation
-uint32_t all_green(uint32_t t, unsigned pixel) {
-  return 0x00ff11;
-}
+File recording;                    // recording UDP show, if open
+uint32_t recordTime;               // time of previous recorded packet
+File show;                         // replaying UDP show, if open
 
 
-// Simple all cyan animation
-uint32_t all_cyan(uint32_t t, unsigned pixel) {
-  return 0x00eeff;
+// Palette file in flash of an uploaded palette
+String paletteFile( unsigned index ) {
+  return String("/palette") + String((int)index);
 }
 
 
-// Simple all blue animation
-uint32_t all_blue(uint32_t t, unsigned pixel) {
-  return 0x1100ff;
+// Load uploaded palette from flash, false if there is none
+bool loadPalette( unsigned index, sparkPalette &palette ) {
+  File file = LittleFS.open(paletteFile(index).c_str(), "r");
+  size_t size = sparkPalette::SIZE * sizeof(sparkPalette::color_t);
+  return file && file.read((uint8_t *)palette.data(), size) == (int)size;
 }
 
 
-// Simple all violet animation
-uint32_t all_violet(uint32_t t, unsigned pixel) {
-  return 0x8800ff;
+// Position recorded UDP show at its first record and read its header
+bool showRewind( record_t &record ) {
+  uint8_t magic[sizeof(SHOW_MAGIC) - 1];
+  return show.seek(0)
+    && show.read(magic, sizeof(magic)) == sizeof(magic)
+    && memcmp(magic, SHOW_MAGIC, sizeof(magic)) == 0
+    && show.read((uint8_t *)&record, sizeof(record)) == sizeof(record);
 }
 
 
-// Theme spark animation
-uint32_t theme_sparks(uint32_t t, unsigned pixel, const baseSpark::color_t colors[], size_t numColors ) {
-  themedSpark::color_t color;
-
-  if( prevMode != mode ) {
-    themedSpark::setTheme(colors, numColors);
-    themedSparks[pixel].reset();
-    pixelData[pixel].spark.setSpark(&themedSparks[pixel], msCircle);
-  }
+// Replay of recorded UDP show.
+// Advances with the first pixel of each frame, segments may not start at pixel 0
+uint32_t replay(uint32_t t, unsigned pixel) {
+  static uint32_t colors[NUM_PIXELS];
+  static uint32_t next;  // time the pending record is due
+  static record_t record;
+  static uint32_t frameTime;
+  static bool started = false;
+
+  if( !started || t != frameTime ) {
+    started = true;
+    frameTime = t;
+    if( prevMode != mode ) {
+      memset(colors, 0, sizeof(colors));
+      show.close();
+      if( !recording ) {
+        show = LittleFS.open(SHOW_FILE, "r");
+      }
+      if( show && !showRewind(record) ) {
+        show.close();
+      }
+      next = t + record.ms;
+    }
 
-  if( pixelData[pixel].spark.get(color) ) {
-    uint32_t col = color.r << 16 | color.g << 8 | color.b;
-    //Serial.printf("Theme 1 p0 %06x = %02x-%02x-%02x\n", col, color.r, color.g, color.b);
-    return col;
+    // Apply all records due until t, restart at end of show
+    unsigned records = 0;
+    while( show && (int32_t)(t - next) >= 0 && records++ < NUM_PIXELS ) {
+      unsigned char block[4];
+      for( ; record.length >= sizeof(block); record.length -= sizeof(block) ) {
+        if( show.read(block, sizeof(block)) != sizeof(block) ) {
+          break;
+        }
+        if( block[0] < NUM_PIXELS ) {
+          colors[block[0]] = block[1] << 16 | block[2] << 8 | block[3];
+        }
+      }
+      if( show.read((uint8_t *)&record, sizeof(record)) != sizeof(record) && !showRewind(record) ) {
+        show.close();
+      }
+      next += record.ms;
+    }
   }
 
-  return 0x000000;
+  return colors[pixel];
 }
 
 
-// Theme red-violet-blue spark animation
-uint32_t theme_red_violet_blue_sparks(uint32_t t, unsigned pixel) {
-  static const baseSpark::color_t colors[] = {
-    {0xff, 0, 0},
-    {0xff, 0, 0xff},
-    {0,    0, 0xff}
-  };
-
-  return theme_sparks(t, pixel, colors, sizeof(colors)/sizeof(*colors));
-}
-
+animator_t animator = animators[0];  // current animation
 
-// Theme red-green-white spark animation
-uint32_t theme_red_green_white_sparks(uint32_t t, unsigned pixel) {
-  static const baseSpark::color_t colors[] = {
-    {0xff,    0,    0},
-    {0,    0xff, 0},
-    {0xff, 0xff, 0xff}
-  };
 
-  return theme_sparks(t, pixel, colors, sizeof(colors)/sizeof(*colors));
+// Builtin default settings, used if Eeprom is erased or invalid
+void setupDefaults() {
+  mode = 0;             // first mode
+  prevMode = mode + 1;  // different from mode forces mode init
+  msCircle = CIRCLE_MS; // default min animation circle time
+  brightness = 255;     // full brightness
+  seed = 0;             // sparks differ on each boot
+  cache = 1;            // cache periodic animations
+  overlay = 0;          // UDP pixels stop animation for one circle
+  overlayAlpha = 255;   // opaque
+  fade = 1000;          // crossfade modes for 1 s
+  palette = NUM_PALETTES - 1; // last palette, it has no builtin theme
+  milliamps = MILLIAMPS;  // limit current to power supply
+  dither = 1;             // show low bits of fades and brightness
+  group = 0;              // unicast only
+  slice = 0;              // strip starts the shared pixel space
+  memset(segments, 0, sizeof(segments)); // no segments
+  memset(mappings, 0, sizeof(mappings));
+  mappings[0].count = NUM_PIXELS;        // all pixels on first output
 }
 
-
-// Theme gold-blue-cyan-green spark animation
-uint32_t theme_gold_blue_cyan_green_sparks(uint32_t t, unsigned pixel) {
-  static const baseSpark::color_t colors[] = {
-    {0xcc, 0x9b, 0x29},
-    {0,    0,    0xff},
-    {0,    0xff, 0xff},
-    {0,    0xff, 0}
-  };
-
-  return theme_sparks(t, pixel, colors, sizeof(colors)/sizeof(*colors));
+// Erase saved settings
+void clearEeprom() {
+  eeprom_t data;
+  memset(&data, 0, sizeof(data));
+  EEPROM.put(0, data);
+  EEPROM.commit();
 }
 
 
-// Theme blue-green-cyan spark animation
-uint32_t theme_green_blue_cyan_sparks(uint32_t t, unsigned pixel) {
-  static const baseSpark::color_t colors[] = {
-    {0, 0,    0xff},
-    {0, 0xff, 0},
-    {0, 0xff, 0xff}
-  };
-
-  return theme_sparks(t, pixel, colors, sizeof(colors)/sizeof(*colors));
+// Save current settings permanently
+void setEeprom() {
+  eeprom_t data { mode, msCircle, brightness, seed, cache, overlay, overlayAlpha, fade, palette, milliamps, dither, group, slice, wifiChannel, {}, {}, {}, EEPROM_MAGIC };
+  memcpy(data.wifiBssid, wifiBssid, sizeof(wifiBssid));
+  memcpy(data.segments, segments, sizeof(segments));
+  memcpy(data.mappings, mappings, sizeof(mappings));
+  EEPROM.put(0, data);
+  EEPROM.commit();
 }
 
 
-// Theme white spark animation
-uint32_t theme_white_sparks(uint32_t t, unsigned pixel) {
-  static const baseSpark::color_t colors[] = {
-    {0, 0, 0}
-  };
+// Read previously saved settings
+void getEeprom() {
+  eeprom_t data;
+  EEPROM.get(0, data);
+  if( data.magic == EEPROM_MAGIC ) {
+    mode = data.mode;
+    msCircle = data.msCircle;
+    brightness = data.brightness;
+    seed = data.seed;
+    cache = data.cache;
+    overlay = data.overlay;
+    overlayAlpha = data.overlayAlpha;
+    fade = data.fade;
+    palette = data.palette;
+    milliamps = data.milliamps;
+    dither = data.dither;
+    group = data.group;
+    slice = data.slice;
+    wifiChannel = data.wifiChannel;
+    memcpy(wifiBssid, data.wifiBssid, sizeof(wifiBssid));
+    memcpy(segments, data.segments, sizeof(segments));
+    for( size_t i = 0; i < MAX_SEGMENTS; i++ ) {
+      segments[i].prevMode = segments[i].mode + 1; // forces init
+    }
+    memcpy(mappings, data.mappings, sizeof(mappings));
 
-  return theme_sparks(t, pixel, colors, sizeof(colors)/sizeof(*colors));
+    // Settings saved before /cfg checked their range
+    brightness = brightness > 255 ? 255 : brightness;
+    overlayAlpha = overlayAlpha > 255 ? 255 : overlayAlpha;
+    overlay = overlay > BLEND_MODES ? 0 : overlay;
+  }
 }
 
 
-// Theme warm spark animation
-uint32_t theme_warm_sparks(uint32_t t, unsigned pixel) {
-  static const baseSpark::color_t colors[] = {
-    {0xff, 0, 0},
-    //{0,    0, 0xff},
-    {0xff, 0x0f, 0},
-    {0xff, 0x1f, 0},
-    {0xff, 0x2f, 0},
-    {0xff, 0x3f, 0},
-    {0xff, 0x4f, 0},
-    {0xff, 0x5f, 0},
-    {0xff, 0x6f, 0},
-    {0xff, 0x7f, 0},
-    {0xff, 0x8f, 0},
-    {0xff, 0x9f, 0},
-    {0xff, 0xaf, 0},
-    {0xff, 0xbf, 0},
-    {0xff, 0xcf, 0},
-    {0xff, 0xdf, 0},
-    {0xff, 0xef, 0},
-    {0xff, 0xff, 0}
-  };
-
-  return theme_sparks(t, pixel, colors, sizeof(colors)/sizeof(*colors));
+// Load uploaded pixel map (or use a vertical line) and precompute its projections
+void setupPixelMap() {
+  File file = LittleFS.open(MAP_FILE, "r");
+  if( !file || file.read((uint8_t *)positions, sizeof(positions)) != sizeof(positions) ) {
+    mapLinear(positions, NUM_PIXELS);
+  }
+  mapProject(positions, projections, NUM_PIXELS);
 }
 
 
-// Random spark animation
-uint32_t random_sparks(uint32_t t, unsigned pixel) {
-  randomSpark::color_t color;
-  if( prevMode != mode ) {
-    randomSparks[pixel].reset();
-    pixelData[pixel].spark.setSpark(&randomSparks[pixel], msCircle);
-  }
-  if( pixelData[pixel].spark.get(color) ) {
-    uint32_t col = color.r << 16 | color.g << 8 | color.b;
-    //Serial.printf("Random p0 %06x = %02x-%02x-%02x\n", col, color.r, color.g, color.b);
-    return col;
+// Compile the uploaded program of the custom animation
+void setupProgram() {
+  File file = LittleFS.open(PROGRAM_FILE, "r");
+  if( file ) {
+    String source = file.readString();
+    if( !program.compile(source.c_str()) ) {
+      INFO("Program error: %s", program.error());
+    }
   }
-
-  return 0x000000;
 }
 
 
-// Rainbow
-uint32_t rainbow(uint32_t t, unsigned pixel) {
-  uint32_t part = t % msCircle; // time in circle
-  uint32_t segment = msCircle / 6; // size of 6 color time segments
-  uint32_t fade; // value of fading color
+// Output strips: all of them are sent in the background (DMA or UART interrupts),
+// so a frame takes as long as the longest strip, not all pixels
 
-  if( part < segment ) { // cyan -> blue
-    fade = 0xffff - (0xffffULL * part) / segment;
-    return ((fade*fade)>>24) << 8 | 0xff;
+uint16_t outputPixels( unsigned output ) {
+#ifdef UART_OUTPUT
+  if( output == 1 ) {
+    return UART_PIXELS;
   }
-  part -= segment;
-  if( part < segment ) { // blue -> violet
-    fade = (0xffffULL * part) / segment;
-    return ((fade*fade)>>24) << 16 | 0xff;
+#endif
+  return DMA_PIXELS;
+}
+
+// Write count colors into the buffer of an output from pixel index on, in the native byte order
+void setOutputColors( unsigned output, uint16_t index, const uint32_t colors[], uint16_t count, bool reversed ) {
+  uint8_t *buffer = pixels.Pixels();
+#ifdef UART_OUTPUT
+  if( output == 1 ) {
+    buffer = uartPixels.Pixels();
   }
-  part -= segment;
-  if( part < segment ) { // violet -> red
-    fade = 0xffff - (0xffffULL * part) / segment;
-    return 0xff << 16 | (fade*fade)>>24;
+#endif
+  buffer += index * 3;
+  if( reversed ) {
+    writeSpanReversed<pixelOrder>(buffer, colors, count);
   }
-  part -= segment;
-  if( part < segment ) { // red -> yellow
-    fade = (0xffffULL * part) / segment;
-    return 0xff << 16 | ((fade*fade)>>24) << 8;
+  else {
+    writeSpan<pixelOrder>(buffer, colors, count);
   }
-  part -= segment;
-  if( part < segment ) { // yellow -> green
-    fade = 0xffff - (0xffffULL * part) / segment;
-    return ((fade*fade)>>24) << 16 | 0xff << 8;
+#ifdef UART_OUTPUT
+  if( output == 1 ) {
+    uartPixels.Dirty();
+    return;
   }
-  part -= segment;
-  // green -> cyan
-  fade = (0xffffULL * part) / segment;
-  return 0xff << 8 | (fade*fade)>>24;
+#endif
+  pixels.Dirty();
 }
 
-
-// Rainbow reversed
-uint32_t rainbow_reversed(uint32_t t, unsigned pixel) {
-  return rainbow(msCircle - 1 - t % msCircle, pixel); // time in circle, reversed
+// Set logical pixels start to start+count-1 on the outputs they are mapped to
+void setOutputSpan( const uint32_t colors[], uint16_t start, uint16_t count ) {
+  for( size_t i = 0; i < MAX_MAPPINGS; i++ ) {
+    const mapping_t &map = mappings[i];
+    uint16_t from = start > map.start ? start : map.start;
+    uint16_t to = start + count < map.start + map.count ? start + count : map.start + map.count;
+    if( from >= to || map.offset + map.count > outputPixels(map.output) ) {
+      continue; // not in this mapping or mapping does not fit (would write beyond the buffer)
+    }
+    uint16_t index = map.offset + (map.reversed ? map.start + map.count - to : from - map.start);
+    setOutputColors(map.output, index, colors + from, to - from, map.reversed);
+  }
 }
 
-
-// Moving rainbow
-uint32_t rainbow_moving(uint32_t t, unsigned pixel) {
-  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
-  return rainbow((t + msOffset*pixel) % msCircle, pixel);
+void clearOutputs() {
+  pixels.ClearTo(RgbColor(0, 0, 0));
+#ifdef UART_OUTPUT
+  uartPixels.ClearTo(RgbColor(0, 0, 0));
+#endif
 }
 
-
-// Moving rainbow in reversed direction
-uint32_t rainbow_moving_reversed(uint32_t t, unsigned pixel) {
-  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
-  return rainbow_reversed((t + msOffset*pixel) % msCircle, pixel);
+bool outputsCanShow() {
+#ifdef UART_OUTPUT
+  if( !uartPixels.CanShow() ) {
+    return false;
+  }
+#endif
+  return pixels.CanShow();
 }
 
-
-// Moving rainbow backwards
-uint32_t rainbow_moving_back(uint32_t t, unsigned pixel) {
-  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
-  return rainbow((t - msOffset*pixel) % msCircle, pixel);
+// Start sending all outputs
+void showOutputs() {
+  pixels.Show();
+#ifdef UART_OUTPUT
+  uartPixels.Show();
+#endif
 }
 
 
-// Moving rainbow in reversed direction backwards
-uint32_t rainbow_moving_reversed_back(uint32_t t, unsigned pixel) {
-  uint32_t msOffset = msCircle / NUM_PIXELS; // time diff between pixels
-  return rainbow_reversed((t - msOffset*pixel) % msCircle, pixel);
+// Show Wifi state on the builtin led, unless its pin drives the second strip
+void onlineLed( bool online ) {
+#ifndef UART_OUTPUT
+  digitalWrite(ONLINE_LED_PIN, online ? LOW : HIGH);
+#endif
 }
 
 
-// Sine Wave Interferences
-
-typedef struct {
-  uint8_t amplitude;
-  uint8_t offset;
-  float frequency;
-  float phaseshift;
-} wave_t;
-
-wave_t wave_red;
-wave_t wave_green;
-wave_t wave_blue;
-
-static uint8_t amplitude_max = UINT8_MAX / 2;
-
-void sine_waves_init() {
-  wave_red.amplitude  = amplitude_max;
-  wave_red.offset     = amplitude_max;
-  wave_red.frequency  = 2.0 * PI / msCircle;    // frequency for one wave per looptime
-  wave_red.phaseshift = 2.0 * PI / NUM_PIXELS;  // phase shift between leds for one full wave
-  wave_red.phaseshift *= -1;
-
-  wave_green.amplitude  = amplitude_max;
-  wave_green.offset     = amplitude_max;
-  wave_green.frequency  = 2.0 * PI / msCircle;    // frequency for one wave per looptime
-  wave_green.phaseshift = 2.0 * PI / NUM_PIXELS;  // phase shift between leds for one full wave
-  wave_green.phaseshift *= 3;
-
-  wave_blue.amplitude  = amplitude_max;
-  wave_blue.offset     = amplitude_max;
-  wave_blue.frequency  = 2.0 * PI / msCircle;    // frequency for one wave per looptime
-  wave_blue.phaseshift = 2.0 * PI / NUM_PIXELS;  // phase shift between leds for one full wave
-  wave_blue.phaseshift *= 2;
-}
-
-// sine waves animation
-uint32_t sine_waves(uint32_t t, unsigned pixel) {
-  uint16_t red, green, blue;
-
-  if( prevMode != mode ) {
-    sine_waves_init();
-    prevMode = mode;
-  }
-
-  red   = uint16_t(wave_red.amplitude   * sin( wave_red.frequency   * t + wave_red.phaseshift   * pixel )) + wave_red.offset;
-  green = uint16_t(wave_green.amplitude * sin( wave_green.frequency * t + wave_green.phaseshift * pixel )) + wave_green.offset;
-  blue  = uint16_t(wave_blue.amplitude  * sin( wave_blue.frequency  * t + wave_blue.phaseshift  * pixel )) + wave_blue.offset;
-
-  red   = (red   * red  ) / (2 * amplitude_max);
-  green = (green * green) / (2 * amplitude_max);
-  blue  = (blue  * blue ) / (2 * amplitude_max);
-
-  uint32_t col = (red & 0xff) << 16 | (green & 0xff) << 8 | (blue & 0xff);
-  return col;
-}
-
-
-// List of animation functions defined above
-animator_t animators[] = {
-  // First entry is default (make it a nice one...)
-  sine_waves,
-  theme_red_violet_blue_sparks,
-  theme_red_green_white_sparks,
-  theme_gold_blue_cyan_green_sparks,
-  theme_green_blue_cyan_sparks,
-  theme_warm_sparks,
-  random_sparks,
-  theme_white_sparks,
-  rainbow,
-  rainbow_reversed,
-  rainbow_moving,
-  rainbow_moving_reversed,
-  rainbow_moving_back,
-  rainbow_moving_reversed_back,
-  all_red,
-  all_yellow,
-  all_green,
-  all_cyan,
-  all_blue,
-  all_violet,
-  all_white,
-  all_black
-};
-
-animator_t animator = animators[0];  // current animation
-
-
-// Builtin default settings, used if Eeprom is erased or invalid
-void setupDefaults() {
-  mode = 0;             // first mode
-  prevMode = mode + 1;  // different from mode forces mode init
-  msCircle = CIRCLE_MS; // default min animation circle time
-}
-
-// Erase saved settings
-void clearEeprom() {
-  eeprom_t data {0};
-  EEPROM.put(0, data);
-  EEPROM.commit();
+// Initiate connection to Wifi but dont wait for it to be established.
+// Channel and access point of the last connection skip the scan, see updaterHandle()
+void wifiSetup() {
+  WiFi.mode(WIFI_STA);
+  WiFi.hostname(NAME);
+  wifiCached = wifiChannel != 0;
+  if( wifiCached ) {
+    WiFi.begin(SSID, PASS, wifiChannel, wifiBssid);
+  }
+  else {
+    WiFi.begin(SSID, PASS);
+  }
+  msWifiDown = millis();
+#ifndef UART_OUTPUT
+  pinMode(ONLINE_LED_PIN, OUTPUT);
+#endif
+  onlineLed(false);
 }
 
 
-// Save current settings permanently
-void setEeprom() {
-  eeprom_t data { mode, msCircle, EEPROM_MAGIC };
-  EEPROM.put(0, data);
-  EEPROM.commit();
-}
+// Call this after mode has been changed to setup new animation
+void setupAnimation() {
+  static uint32_t validMode = 0;
+
+  INFO("Animation mode: %u, circle: %u ms, brightness: %u, seed: %u", mode, msCircle, brightness, seed);
+  if( mode < NUM_MODES ) {
+    if( fade && mode != validMode ) {
+      // Crossfade from the previous mode, it keeps its sparks in the other bank.
+      // If already fading, the original outgoing mode stays and the fade restarts
+      if( !fadeFrom.count ) {
+        fadeFrom.mode = fadeFrom.prevMode = validMode;
+        fadeFrom.start = 0;
+        fadeFrom.count = NUM_PIXELS;
+        fadeSparks = sparks;
+        sparks = (sparks == &sparkBanks[0]) ? &sparkBanks[1] : &sparkBanks[0];
+      }
+      fadeFrames = 0;
+    }
+    animator = animators[mode];
+    validMode = mode;
+  }
+  else {
+    mode = validMode;
+  }
 
+  if( seed ) {
+    // Restart animation with reproducible sparks
+    sparkRandom::seed(seed);
+    prevMode = mode + 1;
+  }
 
-// Read previously saved settings
-void getEeprom() {
-  eeprom_t data;
-  EEPROM.get(0, data);
-  if( data.magic == EEPROM_MAGIC ) {
-    mode = data.mode;
-    msCircle = data.msCircle;
+  // Start recording a new circle into the frame cache (see cacheRecord())
+  frames.end();
+  if( cache && isPeriodic(animator) ) {
+    if( msCircle > CACHE_CIRCLE_MS ) {
+      INFO("Frame cache: circle longer than %u ms, rendering live", CACHE_CIRCLE_MS);
+    }
+    else if( !frames.begin((msCircle + INTERVAL_MS - 1) / INTERVAL_MS, NUM_PIXELS, CACHE_BUDGET) ) {
+      INFO("Frame cache: no memory, rendering live");
+    }
   }
 }
 
 
-// Initiate connection to Wifi but dont wait for it to be established
-void wifiSetup() {
-  WiFi.mode(WIFI_STA);
-  WiFi.hostname(NAME);
-  WiFi.begin(SSID, PASS);
-  pinMode(ONLINE_LED_PIN, OUTPUT);
-  digitalWrite(ONLINE_LED_PIN, HIGH);
-}
+// Run each animation for some frames with fixed clock and seed.
+// Reports a frame checksum (to detect changed output) and the render time per frame
+void send_bench( uint32_t frames, uint32_t benchSeed, uint32_t benchCircle ) {
+  static const size_t numAnimators = NUM_MODES;
+  uint32_t savedMode = mode;
+  uint32_t savedCircle = msCircle;
 
+  DynamicJsonDocument jsonDoc(200 + numAnimators * 80);
+  jsonDoc["frames"] = frames;
+  jsonDoc["seed"] = benchSeed;
+  jsonDoc["circle"] = benchCircle;
+  JsonArray results = jsonDoc.createNestedArray("modes");
 
-// Call this after mode has been changed to setup new animation
-void setupAnimation() {
-  INFO("Animation mode: %u, circle: %u ms", mode, msCircle);
-  if( mode < sizeof(animators)/sizeof(*animators) ) {
+  msCircle = benchCircle;
+  for( mode = 0; mode < numAnimators; mode++ ) {
     animator = animators[mode];
+    prevMode = mode + 1; // forces init
+    sparkRandom::seed(benchSeed);
+
+    uint32_t hash = 2166136261UL; // FNV-1a over r, g, b of all frames
+    uint32_t usTotal = 0;
+    uint32_t usMax = 0;
+    for( uint32_t frame = 0; frame < frames; frame++ ) {
+      uint32_t colors[NUM_PIXELS];
+      uint32_t t = benchCircle + frame * INTERVAL_MS;
+      uint32_t start = micros();
+      for( unsigned pixel=0; pixel<NUM_PIXELS; pixel++ ) {
+        colors[pixel] = (*animator)(t, pixel);
+      }
+      prevMode = mode;
+      uint32_t us = micros() - start;
+      usTotal += us;
+      if( us > usMax ) {
+        usMax = us;
+      }
+      for( unsigned pixel=0; pixel<NUM_PIXELS; pixel++ ) {
+        for( int shift = 16; shift >= 0; shift -= 8 ) {
+          hash = (hash ^ ((colors[pixel] >> shift) & 0xff)) * 16777619UL;
+        }
+      }
+      yield();
+    }
+
+    JsonObject result = results.createNestedObject();
+    result["mode"] = mode;
+    result["hash"] = hash;
+    result["us"] = frames ? usTotal / frames : 0;
+    result["usMax"] = usMax;
   }
-  else {
-    mode = prevMode;
+
+  // Continue with the previous animation
+  mode = savedMode;
+  msCircle = savedCircle;
+  setupAnimation();
+  prevMode = mode + 1; // sparks were reset by the benchmark
+  fadeFrom.count = 0;
+  for( size_t i = 0; i < MAX_SEGMENTS; i++ ) {
+    segments[i].prevMode = segments[i].mode + 1;
   }
+
+  String msg;
+  serializeJson(jsonDoc, msg);
+  web_server.send(200, "application/json", msg);
 }
 
 
@@ -564,6 +699,17 @@ void send_menu() {
               "<option %svalue=\"19\">Violet</option>\n"
               "<option %svalue=\"20\">White</option>\n"
               "<option %svalue=\"21\">Off</option>\n"
+              "<option %svalue=\"22\">Replay</option>\n"
+              "<option %svalue=\"23\">Sparks palette</option>\n"
+              "<option %svalue=\"24\">Rainbow rising</option>\n"
+              "<option %svalue=\"25\">Rainbow spheres</option>\n"
+              "<option %svalue=\"26\">Rainbow spiral</option>\n"
+              "<option %svalue=\"27\">Sine waves rising</option>\n"
+              "<option %svalue=\"28\">Custom program</option>\n"
+              "<option %svalue=\"29\">Fire</option>\n"
+              "<option %svalue=\"30\">Snow</option>\n"
+              "<option %svalue=\"31\">Twinkle</option>\n"
+              "<option %svalue=\"32\">Self test</option>\n"
             "</select>\n"
           "</label></td><td>\n"
           "<button>Configure</button></td></tr><tr><td>\n"
@@ -625,7 +771,8 @@ void send_menu() {
     mode==6?sel:"", mode==7?sel:"", mode==8?sel:"", mode==9?sel:"",
     mode==10?sel:"", mode==11?sel:"", mode==12?sel:"", mode==13?sel:"",
     mode==14?sel:"", mode==15?sel:"", mode==16?sel:"", mode==17?sel:"",
-    mode==18?sel:"", mode==19?sel:"", mode==20?sel:"", mode==21?sel:"",
+    mode==18?sel:"", mode==19?sel:"", mode==20?sel:"", mode==21?sel:"", mode==22?sel:"", mode==23?sel:"",
+    mode==24?sel:"", mode==25?sel:"", mode==26?sel:"", mode==27?sel:"", mode==28?sel:"", mode==29?sel:"", mode==30?sel:"", mode==31?sel:"", mode==32?sel:"",
     msCircle==10?sel:"", msCircle==100?sel:"", msCircle==500?sel:"",
     msCircle==1000?sel:"", msCircle==4000?sel:"", msCircle==10000?sel:"",
     msCircle==20000?sel:"", msCircle==60000?sel:"", msCircle==600000?sel:""
@@ -639,6 +786,28 @@ void send_menu() {
 }
 
 
+// Listen for UDP packets on our port, also for packets to the multicast group, if configured
+void udpBegin() {
+  udpSocket.stop();
+  if( udpGroup.isSet() ) {
+    // Stopping the socket doesn't leave the group it joined
+    igmp_leavegroup(ip_2_ip4(&udpInterface), ip_2_ip4(&udpGroup));
+    udpGroup = IPAddress();
+  }
+  if( group ) {
+    udpInterface = WiFi.localIP();
+    if( udpSocket.beginMulticast(udpInterface, IPAddress(group), UDP_PORT) ) {
+      udpGroup = IPAddress(group);
+    }
+    INFO("Listening on UDP port %u and group %s, slice from pixel %u", UDP_PORT, IPAddress(group).toString().c_str(), slice);
+  }
+  else {
+    udpSocket.begin(UDP_PORT);
+    INFO("Listening on UDP port %u", udpSocket.localPort());
+  }
+}
+
+
 // Define web pages for update, reset or for configuring parameters
 void webserverSetup() {
 
@@ -647,6 +816,269 @@ void webserverSetup() {
     web_server.send(200, "text/plain", "ok: " VERSION "\n");
   });
 
+  // Call this page to see the frame counters and the hash of the shown frame
+  web_server.on("/frames", []() {
+    DynamicJsonDocument jsonDoc(300);
+    jsonDoc["queued"] = framesQueued;
+    jsonDoc["shown"] = framesShown;
+    jsonDoc["unchanged"] = framesUnchanged;
+    jsonDoc["skipped"] = framesSkipped;
+    jsonDoc["lag"] = frameLagMax;
+    jsonDoc["hash"] = frameHash;
+    jsonDoc["milliamps"] = frameMilliamps;
+    jsonDoc["limited"] = framesLimited;
+    String msg;
+    serializeJson(jsonDoc, msg);
+    web_server.send(200, "application/json", msg);
+  });
+
+  // Call this page to benchmark all animations (/bench[?frames=n&seed=s&circle=ms])
+  web_server.on("/bench", []() {
+    uint32_t frames = web_server.hasArg("frames") ? strtoul(web_server.arg("frames").c_str(), NULL, 0) : 100;
+    uint32_t benchSeed = web_server.hasArg("seed") ? strtoul(web_server.arg("seed").c_str(), NULL, 0) : 1;
+    uint32_t benchCircle = web_server.hasArg("circle") ? strtoul(web_server.arg("circle").c_str(), NULL, 0) : CIRCLE_MS;
+    if( benchCircle == 0 ) {
+      web_server.send(400, "text/plain", "error: circle must not be 0\n");
+    }
+    else {
+      send_bench(frames, benchSeed, benchCircle);
+    }
+  });
+
+  // Call this page to toggle recording of UDP packets for replay mode
+  web_server.on("/record", []() {
+    if( recording ) {
+      String msg("ok: recorded ");
+      msg += String((int)recording.size()) + " bytes\n";
+      recording.close();
+      if( animator == replay ) {
+        prevMode = mode + 1; // reopen show
+      }
+      for( size_t i = 0; i < MAX_SEGMENTS; i++ ) {
+        if( segments[i].count && animators[segments[i].mode] == replay ) {
+          segments[i].prevMode = segments[i].mode + 1;
+        }
+      }
+      web_server.send(200, "text/plain", msg);
+    }
+    else {
+      show.close();
+      recording = LittleFS.open(SHOW_FILE, "w");
+      if( recording && recording.write((const uint8_t *)SHOW_MAGIC, sizeof(SHOW_MAGIC) - 1) == sizeof(SHOW_MAGIC) - 1 ) {
+        recordTime = 0;
+        web_server.send(200, "text/plain", "ok: recording\n");
+      }
+      else {
+        recording.close();
+        web_server.send(500, "text/plain", "error: cannot write " SHOW_FILE "\n");
+      }
+    }
+  });
+
+  // Call this page to show or change animation segments
+  // (/segment?index=i&start=pixel&count=n&mode=m[&blend=b&alpha=a], count=0 removes)
+  web_server.on("/segment", []() {
+    if( web_server.args() ) {
+      uint32_t index = strtoul(web_server.arg("index").c_str(), NULL, 0);
+      segment_t seg;
+      seg.start = strtoul(web_server.arg("start").c_str(), NULL, 0);
+      seg.count = strtoul(web_server.arg("count").c_str(), NULL, 0);
+      seg.mode = strtoul(web_server.arg("mode").c_str(), NULL, 0);
+      seg.prevMode = seg.mode + 1;
+      seg.blend = web_server.hasArg("blend") ? strtoul(web_server.arg("blend").c_str(), NULL, 0) : BLEND_REPLACE;
+      seg.alpha = web_server.hasArg("alpha") ? strtoul(web_server.arg("alpha").c_str(), NULL, 0) : 255;
+      if( index >= MAX_SEGMENTS || (uint32_t)seg.start + seg.count > NUM_PIXELS
+        || seg.mode >= NUM_MODES || seg.blend >= BLEND_MODES ) {
+        web_server.send(400, "text/plain", "error: use index,start,count,mode[,blend,alpha]\n");
+        return;
+      }
+      segments[index] = seg;
+      setEeprom();
+    }
+
+    DynamicJsonDocument jsonDoc(100 + MAX_SEGMENTS * 100);
+    JsonArray segs = jsonDoc.createNestedArray("segments");
+    for( size_t i = 0; i < MAX_SEGMENTS; i++ ) {
+      JsonObject seg = segs.createNestedObject();
+      seg["start"] = segments[i].start;
+      seg["count"] = segments[i].count;
+      seg["mode"] = segments[i].mode;
+      seg["blend"] = segments[i].blend;
+      seg["alpha"] = segments[i].alpha;
+    }
+    String msg;
+    serializeJson(jsonDoc, msg);
+    web_server.send(200, "application/json", msg);
+  });
+
+  // Call this page to map logical pixels to outputs (/output?index=i&start=s&count=c&output=o&offset=f[&reversed=1]).
+  // count=0 removes a mapping. Without parameters the mappings are listed
+  web_server.on("/output", []() {
+    if( web_server.args() ) {
+      uint32_t index = strtoul(web_server.arg("index").c_str(), NULL, 0);
+      mapping_t map;
+      map.start = strtoul(web_server.arg("start").c_str(), NULL, 0);
+      map.count = strtoul(web_server.arg("count").c_str(), NULL, 0);
+      map.offset = strtoul(web_server.arg("offset").c_str(), NULL, 0);
+      map.output = strtoul(web_server.arg("output").c_str(), NULL, 0);
+      map.reversed = strtoul(web_server.arg("reversed").c_str(), NULL, 0) != 0;
+      if( index >= MAX_MAPPINGS || (uint32_t)map.start + map.count > NUM_PIXELS
+        || map.output >= NUM_OUTPUTS || (uint32_t)map.offset + map.count > outputPixels(map.output) ) {
+        web_server.send(400, "text/plain", "error: use index,start,count,output,offset[,reversed]\n");
+        return;
+      }
+      mappings[index] = map;
+      remapped = true;
+      setEeprom();
+    }
+
+    DynamicJsonDocument jsonDoc(200 + MAX_MAPPINGS * 100);
+    JsonArray outputs = jsonDoc.createNestedArray("outputs");
+    for( unsigned output = 0; output < NUM_OUTPUTS; output++ ) {
+      outputs.add(outputPixels(output));
+    }
+    JsonArray maps = jsonDoc.createNestedArray("mappings");
+    for( size_t i = 0; i < MAX_MAPPINGS; i++ ) {
+      JsonObject map = maps.createNestedObject();
+      map["start"] = mappings[i].start;
+      map["count"] = mappings[i].count;
+      map["output"] = mappings[i].output;
+      map["offset"] = mappings[i].offset;
+      map["reversed"] = mappings[i].reversed;
+    }
+    String msg;
+    serializeJson(jsonDoc, msg);
+    web_server.send(200, "application/json", msg);
+  });
+
+  // Call this page to upload a palette (/palette?index=i&colors=rrggbb,rrggbb...[&gradient=0]).
+  // Without colors the palette is reset to its default
+  web_server.on("/palette", []() {
+    uint32_t index = strtoul(web_server.arg("index").c_str(), NULL, 0);
+    if( !web_server.hasArg("index") || index >= NUM_PALETTES ) {
+      web_server.send(400, "text/plain", "error: use index,colors[,gradient]\n");
+      return;
+    }
+
+    if( !web_server.hasArg("colors") ) {
+      LittleFS.remove(paletteFile(index).c_str());
+      paletteLoaded[index] = false;
+      getPalette(index); // running sparks show the builtin theme at once
+      web_server.send(200, "text/plain", "ok: default palette\n");
+      return;
+    }
+
+    static baseSpark::color_t colors[sparkPalette::SIZE];
+    uint16_t numColors = 0;
+    String colorsArg = web_server.arg("colors");
+    const char *arg = colorsArg.c_str();
+    while( *arg && numColors < sparkPalette::SIZE ) {
+      char *end;
+      uint32_t color = strtoul(arg, &end, 16);
+      if( end == arg ) {
+        break;
+      }
+      colors[numColors].r = color >> 16;
+      colors[numColors].g = color >> 8;
+      colors[numColors].b = color;
+      numColors++;
+      arg = (*end == ',') ? end + 1 : end;
+    }
+    if( numColors == 0 || *arg ) {
+      web_server.send(400, "text/plain", "error: colors are hex rrggbb separated by ,\n");
+      return;
+    }
+
+    if( web_server.arg("gradient") == "0" ) {
+      palettes[index].set(colors, numColors);
+    }
+    else {
+      palettes[index].gradient(colors, numColors);
+    }
+    paletteLoaded[index] = true;
+
+    size_t size = sparkPalette::SIZE * sizeof(sparkPalette::color_t);
+    File file = LittleFS.open(paletteFile(index).c_str(), "w");
+    if( !file || file.write((const uint8_t *)palettes[index].data(), size) != size ) {
+      web_server.send(500, "text/plain", "error: palette not saved\n");
+      return;
+    }
+    web_server.send(200, "text/plain", "ok: palette saved\n");
+  });
+
+  // Post pixel coordinates "x,y,z" (any unit, z is up), one line per pixel, to this page
+  // to define the pixel map for spatial animations. Get it to see the normalized map
+  web_server.on("/map", HTTP_POST, []() {
+    static int32_t coords[NUM_PIXELS][3];
+    String body = web_server.arg("plain");
+    const char *pos = body.c_str();
+    unsigned pixel = 0;
+    while( *pos && pixel < NUM_PIXELS ) {
+      for( int axis = 0; axis < 3; axis++ ) {
+        char *end;
+        coords[pixel][axis] = strtol(pos, &end, 0);
+        if( end == pos ) {
+          web_server.send(400, "text/plain", "error: post x,y,z for each pixel\n");
+          return;
+        }
+        pos = (*end == ',') ? end + 1 : end;
+      }
+      while( *pos == '\r' || *pos == '\n' || *pos == ' ' ) {
+        pos++;
+      }
+      pixel++;
+    }
+    if( pixel != NUM_PIXELS ) {
+      web_server.send(400, "text/plain", "error: post x,y,z for each pixel\n");
+      return;
+    }
+
+    mapNormalize(coords, positions, NUM_PIXELS);
+    mapProject(positions, projections, NUM_PIXELS);
+    setupAnimation(); // recache spatial animations
+
+    File file = LittleFS.open(MAP_FILE, "w");
+    if( !file || file.write((const uint8_t *)positions, sizeof(positions)) != sizeof(positions) ) {
+      web_server.send(500, "text/plain", "error: map not saved\n");
+      return;
+    }
+    web_server.send(200, "text/plain", "ok: map saved\n");
+  });
+
+  web_server.on("/map", HTTP_GET, []() {
+    String msg;
+    for( unsigned pixel = 0; pixel < NUM_PIXELS; pixel++ ) {
+      msg += String(positions[pixel].x) + "," + String(positions[pixel].y) + "," + String(positions[pixel].z) + "\n";
+    }
+    web_server.send(200, "text/plain", msg);
+  });
+
+  // Post the source of the custom animation program to this page (or use /program?code=...).
+  // Get it without code to see the current source
+  web_server.on("/program", []() {
+    String source = web_server.hasArg("code") ? web_server.arg("code") : web_server.arg("plain");
+    if( source.length() == 0 ) {
+      File file = LittleFS.open(PROGRAM_FILE, "r");
+      web_server.send(200, "text/plain", file ? file.readString() : String(""));
+      return;
+    }
+
+    static vmProgram compiled; // keep running program if new one has errors
+    if( !compiled.compile(source.c_str()) ) {
+      web_server.send(400, "text/plain", String("error: ") + compiled.error() + "\n");
+      return;
+    }
+    program = compiled;
+    program.setPalette(&getPalette(palette < NUM_PALETTES ? palette : 0));
+
+    File file = LittleFS.open(PROGRAM_FILE, "w");
+    if( !file || file.write((const uint8_t *)source.c_str(), source.length()) != source.length() ) {
+      web_server.send(500, "text/plain", "error: program not saved\n");
+      return;
+    }
+    web_server.send(200, "text/plain", "ok: program saved\n");
+  });
+
   // Call this page to toggle pause animation
   web_server.on("/pause", []() {
     paused = !paused;
@@ -678,24 +1110,55 @@ void webserverSetup() {
   web_server.on("/cfg", []() {
     typedef struct arg {
       const char* name; // Parameter name used in the URI
-      const char  type; // Parameter type: (f)loat or (u)nsigned int
+      const char  type; // Parameter type: (f)loat, (u)nsigned int or (i)p address
       void       *pval; // Pointer to the variable receiving the changed value
+      uint32_t    min;  // Min value of an unsigned int
+      uint32_t    max;  // Max value of an unsigned int
     } arg_t;
 
     // Supported parameters
     arg_t args[] = {
-      { "mode",   'u', &mode     },
-      { "circle", 'u', &msCircle } };
+      { "mode",       'u', &mode,         0, UINT32_MAX       },
+      { "circle",     'u', &msCircle,     1, UINT32_MAX       },
+      { "brightness", 'u', &brightness,   0, 255              },
+      { "seed",       'u', &seed,         0, UINT32_MAX       },
+      { "cache",      'u', &cache,        0, UINT32_MAX       },
+      { "overlay",    'u', &overlay,      0, BLEND_MODES      },
+      { "oalpha",     'u', &overlayAlpha, 0, 255              },
+      { "fade",       'u', &fade,         0, UINT32_MAX       },
+      { "palette",    'u', &palette,      0, NUM_PALETTES - 1 },
+      { "milliamps",  'u', &milliamps,    0, UINT32_MAX       },
+      { "dither",     'u', &dither,       0, UINT32_MAX       },
+      { "group",      'i', &group,        0, 0                },
+      { "slice",      'u', &slice,        0, 65535            } };
 
     bool ok = true;    // So far all processed URI parameters were ok
     int processed = 0; // Count processed URI parameters
+    uint32_t prevGroup = group;
 
     if( web_server.args() == 0 ) {
-      DynamicJsonDocument jsonDoc(200);
+      DynamicJsonDocument jsonDoc(512);
       jsonDoc["version"] = VERSION;
       JsonObject cfg = jsonDoc.createNestedObject("cfg");
       cfg["mode"] = mode;
       cfg["circle"] = msCircle;
+      cfg["brightness"] = brightness;
+      cfg["seed"] = seed;
+      cfg["cache"] = cache;
+      cfg["overlay"] = overlay;
+      cfg["oalpha"] = overlayAlpha;
+      cfg["fade"] = fade;
+      cfg["palette"] = palette;
+      cfg["milliamps"] = milliamps;
+      cfg["dither"] = dither;
+      cfg["group"] = IPAddress(group).toString();
+      cfg["slice"] = slice;
+      JsonObject cached = jsonDoc.createNestedObject("cached");
+      cached["frames"] = frames.added();
+      cached["bytes"] = frames.size();
+      cached["ready"] = frames.ready();
+      cached["budget"] = CACHE_BUDGET;
+      cached["maxcircle"] = CACHE_CIRCLE_MS;
       // cfg["l"] = l;
       // JsonObject& color = cfg.createNestedObject("colors");
       // color["p"] = pd_color;
@@ -711,10 +1174,29 @@ void webserverSetup() {
               *(float *)(args[i].pval) = web_server.arg(args[i].name).toFloat();
               processed++;
               break;
-            case 'u':
-              *(uint32_t *)(args[i].pval) = strtoul(web_server.arg(args[i].name).c_str(), NULL, 0);
-              processed++;
+            case 'u': {
+              uint32_t value = strtoul(web_server.arg(args[i].name).c_str(), NULL, 0);
+              if( value >= args[i].min && value <= args[i].max ) {
+                *(uint32_t *)(args[i].pval) = value;
+                processed++;
+              }
+              else {
+                ok = false; // out of range, e.g. brightness above 255 would overflow scaleSpan16(), circle 0 divides by 0
+              }
+              break;
+            }
+            case 'i': {
+              IPAddress ip; // 0 or 0.0.0.0 for none
+              String value = web_server.arg(args[i].name);
+              if( value == "0" || (ip.fromString(value.c_str()) && (ip == IPAddress() || (ip[0] & 0xf0) == 0xe0)) ) {
+                *(uint32_t *)(args[i].pval) = ip;
+                processed++;
+              }
+              else {
+                ok = false; // not a multicast address
+              }
               break;
+            }
             default:
               ok=false;
           }
@@ -725,6 +1207,9 @@ void webserverSetup() {
       if( ok && processed == web_server.args() ) {
         setupAnimation();
         setEeprom();
+        if( group != prevGroup && WiFi.status() == WL_CONNECTED ) {
+          udpBegin();
+        }
         send_menu();
       }
       else {
@@ -748,7 +1233,9 @@ void webserverSetup() {
   // Catch all page, gives a hint on valid URLs
   web_server.onNotFound([]() {
     web_server.send(404, "text/plain", "error: use "
-      "/cfg?parm=value[&parm=value...] /reset, /clear, /version or "
+      "/cfg?parm=value[&parm=value...] /segment?index=i&parm=value[...], "
+      "/palette?index=i&colors=rrggbb[,rrggbb...], /map, /program, /output, /frames, "
+      "/reset, /clear, /version, /bench, /record or "
       "post image to /update\n");
   });
 
@@ -758,6 +1245,29 @@ void webserverSetup() {
 }
 
 
+// Keep channel and access point of the Wifi connection in EEPROM for a fast connect on next boot
+void wifiRemember() {
+  uint8_t *bssid = WiFi.BSSID();
+  if( (uint32_t)WiFi.channel() == wifiChannel && memcmp(bssid, wifiBssid, sizeof(wifiBssid)) == 0 ) {
+    return;
+  }
+  wifiChannel = WiFi.channel();
+  memcpy(wifiBssid, bssid, sizeof(wifiBssid));
+
+  eeprom_t data;
+  EEPROM.get(0, data);
+  if( data.magic == EEPROM_MAGIC ) { // Only update the cache, current settings may be unsaved
+    data.wifiChannel = wifiChannel;
+    memcpy(data.wifiBssid, wifiBssid, sizeof(wifiBssid));
+    EEPROM.put(0, data);
+    EEPROM.commit();
+  }
+  else {
+    setEeprom();
+  }
+}
+
+
 // Handle online web updater, initialize it after Wifi connection is established
 void updaterHandle() {
   static bool updater_needs_setup = true;
@@ -765,10 +1275,18 @@ void updaterHandle() {
   if( WiFi.status() == WL_CONNECTED ) {
     if( updater_needs_setup ) {
       // Init once after connection is (re)established
-      digitalWrite(ONLINE_LED_PIN, LOW);
+      onlineLed(true);
       Serial.printf("WLAN '%s' connected with IP ", SSID);
       Serial.println(WiFi.localIP());
       INFO("WLAN '%s' connected with IP %s", SSID, WiFi.localIP().toString().c_str());
+      if( !msNetwork ) {
+        msNetwork = millis();
+        Serial.printf("Network after %u ms\n", msNetwork);
+        INFO("Boot: first frame after %u ms, network after %u ms (%s)", msFirstFrame, msNetwork,
+          wifiCached ? "cached channel" : "scanned");
+      }
+      wifiCached = false;
+      wifiRemember();
 
       MDNS.begin(NAME);
 
@@ -777,10 +1295,8 @@ void updaterHandle() {
 
       Serial.println("Update with curl -F 'image=@firmware.bin' " NAME ".local/update");
 
-      udpSocket.begin(UDP_PORT);
+      udpBegin();
       MDNS.addService(NAME, "udp", udpSocket.localPort());
-      Serial.printf("Listening on UDP port %u\n", udpSocket.localPort());
-      INFO("Listening on UDP port %u", udpSocket.localPort());
 
       INFO("Reset reason: %s", ESP.getResetInfo().c_str());
 
@@ -792,83 +1308,442 @@ void updaterHandle() {
     if( ! updater_needs_setup ) {
       // Cleanup once after connection is lost
       udpSocket.stop();
-      digitalWrite(ONLINE_LED_PIN, HIGH);
+      onlineLed(false);
       updater_needs_setup = true;
+      msWifiDown = millis();
+    }
+    if( wifiCached && millis() - msWifiDown > WIFI_CACHED_MS ) {
+      // Access point or channel changed since the last connection
+      Serial.println("WLAN not found on cached channel, scanning");
+      wifiCached = false;
+      WiFi.begin(SSID, PASS);
     }
   }
 }
 
 
-// Set pixels according to animation data
-bool setAnimationPixels( uint32_t t ) {
+// Estimated current of pixels with a sum of all their 16 bit channels
+uint32_t channelsMilliamps( uint32_t channels ) {
+  return NUM_PIXELS * PIXEL_IDLE_MA + (uint64_t)channels * CHANNEL_MA / 0xffff;
+}
+
+
+// Scale (0-65536) that keeps a frame with a sum of all its channels within the current budget
+uint32_t limitPower( uint32_t channels ) {
+  frameMilliamps = channelsMilliamps(channels);
+  if( milliamps == 0 || frameMilliamps <= milliamps ) {
+    return 0x10000;
+  }
+
+  // Scale the current above idle, rounded down to stay below the budget
+  uint32_t idle = channelsMilliamps(0);
+  uint32_t available = milliamps > idle ? milliamps - idle : 0;
+  uint32_t scale = ((uint64_t)available * 0xffff * 0x10000) / ((uint64_t)channels * CHANNEL_MA);
+  frameMilliamps = channelsMilliamps(((uint64_t)channels * scale) >> 16);
+  framesLimited++;
+  return scale;
+}
+
+
+// Apply a binary UDP control message. Takes effect with the next frame.
+void handleControl( const control_t &ctl ) {
+  bool changed = false;
+
+  if( (ctl.flags & CONTROL_MODE) && ctl.mode != mode ) {
+    mode = ctl.mode;
+    changed = true;
+  }
+  if( (ctl.flags & CONTROL_CIRCLE) && ctl.msCircle && ctl.msCircle != msCircle ) {
+    msCircle = ctl.msCircle;
+    changed = true;
+  }
+  if( ctl.flags & CONTROL_BRIGHTNESS ) {
+    brightness = ctl.brightness;
+  }
+  if( ctl.flags & CONTROL_PAUSE ) {
+    paused = ctl.paused != 0;
+  }
+
+  if( changed ) {
+    setupAnimation();
+  }
+  if( ctl.flags & CONTROL_PERSIST ) {
+    setEeprom();
+  }
+}
+
+
+// Append pixel blocks of a UDP packet to the recorded show
+void recordPacket( uint32_t t, const uint8_t *blocks, size_t length ) {
+  uint32_t ms = recordTime ? t - recordTime : 0;
+  recordTime = t;
+
+  record_t record = { 0xffff, 0 };
+  for( ; ms > 0xffff; ms -= 0xffff ) { // long pauses as empty records
+    recording.write((const uint8_t *)&record, sizeof(record));
+  }
+  record.ms = ms;
+  record.length = length;
+  if( recording.write((const uint8_t *)&record, sizeof(record)) != sizeof(record)
+    || recording.write(blocks, length) != length ) {
+    INFO("Recording stopped at %u bytes", recording.size());
+    recording.close();
+  }
+}
+
+
+// Render animation of a segment into colors for its pixels, with spark state in bank
+void renderSegment( segment_t &seg, uint32_t t, uint32_t colors[], sparks_t *bank ) {
+  // Animators check the global modes to init their pixels and use the global spark state
+  uint32_t mainMode = mode;
+  uint32_t mainPrevMode = prevMode;
+  sparks_t *mainSparks = sparks;
+  mode = seg.mode;
+  prevMode = seg.prevMode;
+  sparks = bank;
+
+  animator_t anim = animators[seg.mode];
+  for( unsigned pixel=0; pixel<seg.count; pixel++ ) {
+    colors[pixel] = (*anim)(t, seg.start + pixel);
+  }
+
+  seg.prevMode = seg.mode;
+  mode = mainMode;
+  prevMode = mainPrevMode;
+  sparks = mainSparks;
+}
+
+
+// Blend outgoing animation of a crossfade onto the colors of the incoming one.
+// Logs the render time of frames with both animations (since usStart) when done
+void crossfade( uint32_t t, uint32_t colors[], uint32_t usStart ) {
+  static uint32_t usTotal;
+  static uint32_t usMax;
+
+  if( fadeFrames++ == 0 ) {
+    fadeStart = t;
+    usTotal = usMax = 0;
+  }
+
+  uint32_t elapsed = t - fadeStart;
+  if( elapsed >= fade ) {
+    fadeFrom.count = 0;
+    INFO("Crossfade %u -> %u: %u frames, %u us avg, %u us max per frame (interval %u us)",
+      fadeFrom.mode, mode, fadeFrames - 1, fadeFrames > 1 ? usTotal / (fadeFrames - 1) : 0, usMax, INTERVAL_MS * 1000);
+    return;
+  }
+
+  uint32_t outgoing[NUM_PIXELS];
+  renderSegment(fadeFrom, t, outgoing, fadeSparks);
+  blendSpan(colors, outgoing, NUM_PIXELS, BLEND_ALPHA, 255 - elapsed * 255 / fade);
+
+  uint32_t us = micros() - usStart;
+  usTotal += us;
+  if( us > usMax ) {
+    usMax = us;
+  }
+}
+
+
+// Set frame colors according to UDP packets and animation data. Returns true if colors were set
+bool setAnimationPixels( uint32_t t, color16_t frame[] ) {
   static uint32_t udpPacketTime = 0;
+  static uint32_t animation[NUM_PIXELS];  // main animation with segments
+  static color16_t animation16[NUM_PIXELS]; // same with low bits of deep color animations
+  static uint32_t udpColors[NUM_PIXELS];  // UDP pixels, if overlay
+  static spanSet udpSpans;                // ranges of pixels in udpColors, may include untouched gaps
+  static uint8_t udpTouched[(NUM_PIXELS + 7) / 8]; // bit per pixel in udpColors
   bool rc = false;
 
   // Check if we have a new UDP packet
   if( udpSocket.parsePacket() > 0 ) {
-    unsigned char msg[4];
+    // Span packets can hold more pixels of the shared space than our slice
+    static unsigned char packet[NUM_PIXELS * NX_BLOCK_SIZE > NX_PACKET_MAX ? NUM_PIXELS * NX_BLOCK_SIZE : NX_PACKET_MAX];
     Serial.printf("Size: %u\n", udpSocket.available());
-    udpPacketTime = t;
-    unsigned pos = 0;
-    while( pos++ < NUM_PIXELS // Read at most NUM_PIXELS
-      && udpSocket.read(msg, sizeof(msg)) == sizeof(msg) ) {
-      if( msg[0] < NUM_PIXELS ) { // Pixel number valid?
-        RgbColor new_color = RgbColor(msg[1], msg[2], msg[3]);
-        if( new_color != pixels.GetPixelColor(msg[0]) ) {
-          pixels.SetPixelColor(msg[0], new_color);
-          rc = true;
+    int size = udpSocket.read(packet, sizeof(packet));
+    if( size > 0 && nxIsControl(packet, size) ) {
+      // Binary control message instead of pixel blocks
+      control_t ctl;
+      memcpy(&ctl, packet, sizeof(ctl));
+      handleControl(ctl);
+    }
+    else if( size > 0 && nxIsSpan(packet, size) ) {
+      // Pixels of the shared space, only those of our slice are recorded as blocks
+      static uint8_t blocks[NUM_PIXELS * NX_BLOCK_SIZE];
+      size_t count = 0;
+      auto set = [&count]( uint16_t pixel, uint8_t r, uint8_t g, uint8_t b ) {
+        if( overlay ) {
+          udpColors[pixel] = r << 16 | g << 8 | b;
+          udpTouched[pixel / 8] |= 1 << (pixel % 8);
+          udpSpans.add(pixel);
+        }
+        if( recording ) {
+          uint8_t *block = &blocks[count * NX_BLOCK_SIZE];
+          block[0] = pixel;
+          block[1] = r;
+          block[2] = g;
+          block[3] = b;
+        }
+        count++;
+      };
+      if( overlay ) {
+        nxDecodeSpan(packet, size, slice, NUM_PIXELS, set);
+      }
+      else {
+        nxDecodeSpan(packet, size, slice, NUM_PIXELS, [frame, &set]( uint16_t pixel, uint8_t r, uint8_t g, uint8_t b ) {
+          frame[pixel] = color16(r << 16 | g << 8 | b);
+          set(pixel, r, g, b);
+        });
+      }
+      if( count ) { // Packets for other slices don't stop the animation
+        udpPacketTime = t;
+        rc = !overlay;
+        if( recording ) {
+          recordPacket(t, blocks, count * NX_BLOCK_SIZE);
         }
       }
     }
+    else if( size >= NX_BLOCK_SIZE ) {
+      udpPacketTime = t;
+      size_t blocks;
+      if( overlay ) {
+        // Collect pixels to blend onto the animation below
+        blocks = nxDecodeBlocks(packet, size, NUM_PIXELS, []( uint8_t pixel, uint8_t r, uint8_t g, uint8_t b ) {
+          udpColors[pixel] = r << 16 | g << 8 | b;
+          udpTouched[pixel / 8] |= 1 << (pixel % 8);
+          udpSpans.add(pixel);
+        });
+      }
+      else {
+        blocks = nxDecodeBlocks(packet, size, NUM_PIXELS, [frame]( uint8_t pixel, uint8_t r, uint8_t g, uint8_t b ) {
+          frame[pixel] = color16(r << 16 | g << 8 | b);
+        });
+        rc = true;
+      }
+      if( recording ) {
+        recordPacket(t, packet, blocks * NX_BLOCK_SIZE);
+      }
+    }
     udpSocket.flush();
   }
-  else if( t - udpPacketTime > msCircle && !paused ) { // Udp pattern stays for one circle
-    // Recalculate and set colors of all pixels
-    for( unsigned pixel=0; pixel<NUM_PIXELS; pixel++ ) {
-      uint32_t color = (*animator)(t, pixel);
-      RgbColor new_color((color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff);
-      if( new_color != pixels.GetPixelColor(pixel) ) {
-        // Serial.printf("set_animation_pixels t=%4ld, c=%06lx\n", t, pixel_color);
-        pixels.SetPixelColor(pixel, new_color);
-        rc = true;
+
+  if( overlay || (t - udpPacketTime > msCircle && !paused) ) { // Udp pattern stays for one circle
+    if( !paused ) {
+      uint32_t usStart = micros();
+      if( frames.ready() ) {
+        // Copy colors of all pixels from the cached circle
+        frames.get((t % msCircle) / INTERVAL_MS, []( uint16_t pixel, uint8_t r, uint8_t g, uint8_t b ) {
+          animation[pixel] = r << 16 | g << 8 | b;
+        });
+        expandSpan(animation16, animation, NUM_PIXELS);
+      }
+      else {
+        // Recalculate colors of all pixels
+        for( unsigned pixel=0; pixel<NUM_PIXELS; pixel++ ) {
+          animatorColorSet = false;
+          animation[pixel] = (*animator)(t, pixel);
+          animation16[pixel] = animatorColorSet ? animatorColor : color16(animation[pixel]);
+        }
+      }
+      prevMode = mode;
+
+      // Blended pixels lose their low bits
+      if( fadeFrom.count ) {
+        crossfade(t, animation, usStart);
+        if( fadeFrom.count ) {
+          expandSpan(animation16, animation, NUM_PIXELS);
+        }
+      }
+
+      // Compose segments onto the main animation
+      for( size_t i = 0; i < MAX_SEGMENTS; i++ ) {
+        segment_t &seg = segments[i];
+        if( seg.count ) {
+          uint32_t colors[NUM_PIXELS];
+          renderSegment(seg, t, colors, &segmentSparks[i]);
+          blendSpan(animation + seg.start, colors, seg.count, seg.blend, seg.alpha);
+          expandSpan(animation16 + seg.start, animation + seg.start, seg.count);
+        }
       }
     }
-    prevMode = mode;
+
+    memcpy(frame, animation16, sizeof(animation16));
+    if( overlay && !udpSpans.empty() ) {
+      if( t - udpPacketTime > msCircle ) { // Udp pixels stay for one circle
+        udpSpans.clear();
+        memset(udpTouched, 0, sizeof(udpTouched));
+      }
+      else {
+        // Spans merged when there were too many also cover untouched pixels: blend runs of touched ones
+        udpSpans.each([frame]( uint16_t start, uint16_t count ) {
+          uint16_t end = start + count;
+          uint16_t pixel = start;
+          while( pixel < end ) {
+            while( pixel < end && !(udpTouched[pixel / 8] & (1 << (pixel % 8))) ) {
+              pixel++;
+            }
+            uint16_t run = pixel;
+            while( pixel < end && (udpTouched[pixel / 8] & (1 << (pixel % 8))) ) {
+              pixel++;
+            }
+            if( pixel > run ) {
+              uint32_t colors[NUM_PIXELS];
+              memcpy(colors, animation + run, (pixel - run) * sizeof(*colors));
+              blendSpan(colors, udpColors + run, pixel - run, overlay - 1, overlayAlpha);
+              expandSpan(frame + run, colors, pixel - run);
+            }
+          }
+        });
+      }
+    }
+    rc = true;
   }
 
   return rc;
 }
 
 
-// Setup on boot
-void setup() {
-  Serial.begin(115200);
+// Producer: handle UDP and render the next frame into the frame queue.
+// The final stage scales the 16 bit frame by brightness and current budget and dithers it to 8 bits.
+// Only frames that differ from the previous one are queued. If the queue is full,
+// the changes are queued with a later frame
+void produceFrame( uint32_t t ) {
+  static color16_t frame[NUM_PIXELS];  // latest frame
+  static color16_t scaled[NUM_PIXELS]; // with brightness applied
+  static uint8_t error[NUM_PIXELS * 3];  // dithering error of each channel
+  static uint32_t output[NUM_PIXELS];  // 8 bit colors of latest frame
+  static uint32_t prev[NUM_PIXELS];    // colors of previous frame, including changes not queued yet
+  static spanSet dirty;                // pixels of prev changed since the last queued frame
+  static uint32_t hash;                // of prev
+
+  // With dithering, also unchanged frames show their low bits in each loop
+  if( setAnimationPixels(t, frame) || dither ) {
+    uint32_t channels = scaleSpan16(scaled, frame, NUM_PIXELS, brightness + 1);
+    ditherSpan(scaled, dither ? error : 0, output, NUM_PIXELS, limitPower(channels));
+    if( frameMilliamps > frameMilliampsMax ) {
+      frameMilliampsMax = frameMilliamps;
+    }
+    spanSet changed;
+    hash = diffFrame(prev, output, NUM_PIXELS, changed);
+    if( changed.empty() ) {
+      framesUnchanged++;
+    }
+    else {
+      changed.each([]( uint16_t start, uint16_t count ) {
+        dirty.add(start, count);
+      });
+    }
+  }
 
-  // Initiate network connection (but dont wait for it)
-  wifiSetup();
+  if( !dirty.empty() ) {
+    frame_t *frame = queue.write();
+    if( frame ) {
+      frame->t = t;
+      frame->hash = hash;
+      frame->dirty = dirty;
+      memcpy(frame->colors, prev, sizeof(prev));
+      queue.push();
+      framesQueued++;
+      dirty.clear();
+    }
+    else {
+      framesSkipped++;
+    }
+  }
+}
 
-  // Init the neopixels
-  pixels.Begin();
 
-  // Simple neopixel test
-  RgbColor colors[] = { RgbColor(0, 0, 0), RgbColor(255, 0, 0), RgbColor(0, 255, 0), RgbColor(0, 0, 255), RgbColor(0, 0, 0) };
-  for( size_t color=0; color<sizeof(colors)/sizeof(*colors); color++ ) {
+// Consumer: show the oldest queued frame as soon as the strip is ready for it
+void consumeFrame( uint32_t t ) {
+  frame_t *frame = queue.front();
+  if( frame && outputsCanShow() ) {
+    if( remapped ) {
+      clearOutputs(); // no leftovers of previous mapping
+      setOutputSpan(frame->colors, 0, NUM_PIXELS);
+      remapped = false;
+    }
+    else {
+      // Only pixels that changed since the previous frame
+      frame->dirty.each([frame]( uint16_t start, uint16_t count ) {
+        setOutputSpan(frame->colors, start, count);
+      });
+    }
+    showOutputs();
+    frameHash = frame->hash;
+    if( t - frame->t > frameLagMax ) {
+      frameLagMax = t - frame->t;
+    }
+    queue.pop();
+    framesShown++;
+  }
+}
+
+
+// Render frames of the current animation circle into the frame cache
+// while there is time left in this loop interval.
+// The cache keeps 8 bits per channel, animations with deeper colors are rendered live
+void cacheRecord( uint32_t t_ms ) {
+  while( frames.recording() && millis() - t_ms < INTERVAL_MS / 2 ) {
+    uint32_t colors[NUM_PIXELS];
+    uint32_t t = msCircle + frames.added() * INTERVAL_MS; // same time base as the live frames
+    animatorColorSet = false;
     for( unsigned pixel=0; pixel<NUM_PIXELS; pixel++ ) {
-      pixels.SetPixelColor(color&1 ? NUM_PIXELS-1-pixel : pixel, colors[color]);
-      pixels.Show();
-      delay(500/NUM_PIXELS); // Each color iteration lasts 0.5 seconds
+      colors[pixel] = (*animator)(t, pixel);
+    }
+    if( animatorColorSet ) {
+      frames.end();
+      INFO("Frame cache: 16 bit colors, rendering live");
+    }
+    else if( !frames.add(colors) ) {
+      INFO("Frame cache: circle needs more than %u bytes, rendering live", CACHE_BUDGET);
+    }
+    else if( frames.ready() ) {
+      INFO("Frame cache: %u frames in %u bytes", frames.frames(), frames.size());
     }
   }
+}
+
+
+// Setup on boot
+void setup() {
+  Serial.begin(115200);
+
+  // Init the neopixels
+  pixels.Begin();
+#ifdef UART_OUTPUT
+  uartPixels.Begin();
+#endif
 
-  // Setup the calculation values
+  // Read saved settings first, so the strip continues with the saved mode right away.
+  // The strip test is the self test mode now, it does not block booting
+  sparkRandom::seed(RANDOM_REG32);
   setupDefaults();
   EEPROM.begin(sizeof(eeprom_t));
   getEeprom();
+
+  // Recorded UDP shows, palettes and pixel map
+  LittleFS.begin();
+  setupPixelMap();
+  setupProgram();
+
+  // No crossfade from the default mode at boot
+  uint32_t msFade = fade;
+  fade = 0;
   setupAnimation();
+  fade = msFade;
 
   paused = false;
 
-  Serial.println("\nBooted " VERSION);
+  // Show the first frame before waiting for anything else
+  uint32_t t_ms = millis();
+  produceFrame(t_ms+msCircle);
+  consumeFrame(t_ms+msCircle);
+  msFirstFrame = millis();
+
+  // Initiate network connection (but dont wait for it)
+  wifiSetup();
+
+  Serial.printf("\nBooted " VERSION ", first frame after %u ms\n", msFirstFrame);
 }
 
 
@@ -880,6 +1755,12 @@ void monitor() {
     prev_millis += interval_ms;
     INFO("Uptime: %u ms, %u mV, memory: %u free heap, %u max block, %u%% fragmented", 
       now, ESP.getVcc(), ESP.getFreeHeap(), ESP.getMaxFreeBlockSize(), ESP.getHeapFragmentation());
+    INFO("Frames: %u queued, %u shown, %u unchanged, %u skipped (strip behind), %u ms max lag",
+      framesQueued, framesShown, framesUnchanged, framesSkipped, frameLagMax);
+    INFO("Current: %u mA estimated, %u mA max, %u frames limited to %u mA",
+      frameMilliamps, frameMilliampsMax, framesLimited, milliamps);
+    frameLagMax = 0;
+    frameMilliampsMax = 0;
   }
 }
 
@@ -891,11 +1772,15 @@ void loop() {
   // Online web update
   updaterHandle();
 
-  // Calcuate new animation values
-  if( setAnimationPixels(t_ms+msCircle) ) {
-    // Update neopixel strip
-    pixels.Show();
-  }
+  // Calcuate new animation values. Network and rendering only talk to the strip
+  // through the frame queue, so they could run in their own task
+  produceFrame(t_ms+msCircle);
+
+  // Update neopixel strip
+  consumeFrame(t_ms+msCircle);
+
+  // Use spare time to fill the frame cache
+  cacheRecord(t_ms);
 
   // regularly log status
   monitor();
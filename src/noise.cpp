@@ -0,0 +1,145 @@
+#include <noise.h>
+
+
+// Ken Perlins permutation, hashes lattice coordinates
+static const uint8_t perm[256] = {
+  151, 160, 137,  91,  90,  15, 131,  13, 201,  95,  96,  53, 194, 233,   7, 225,
+  140,  36, 103,  30,  69, 142,   8,  99,  37, 240,  21,  10,  23, 190,   6, 148,
+  247, 120, 234,  75,   0,  26, 197,  62,  94, 252, 219, 203, 117,  35,  11,  32,
+   57, 177,  33,  88, 237, 149,  56,  87, 174,  20, 125, 136, 171, 168,  68, 175,
+   74, 165,  71, 134, 139,  48,  27, 166,  77, 146, 158, 231,  83, 111, 229, 122,
+   60, 211, 133, 230, 220, 105,  92,  41,  55,  46, 245,  40, 244, 102, 143,  54,
+   65,  25,  63, 161,   1, 216,  80,  73, 209,  76, 132, 187, 208,  89,  18, 169,
+  200, 196, 135, 130, 116, 188, 159,  86, 164, 100, 109, 198, 173, 186,   3,  64,
+   52, 217, 226, 250, 124, 123,   5, 202,  38, 147, 118, 126, 255,  82,  85, 212,
+  207, 206,  59, 227,  47,  16,  58,  17, 182, 189,  28,  42, 223, 183, 170, 213,
+  119, 248, 152,   2,  44, 154, 163,  70, 221, 153, 101, 155, 167,  43, 172,   9,
+  129,  22,  39, 253,  19,  98, 108, 110,  79, 113, 224, 232, 178, 185, 112, 104,
+  218, 246,  97, 228, 251,  34, 242, 193, 238, 210, 144,  12, 191, 179, 162, 241,
+   81,  51, 145, 235, 249,  14, 239, 107,  49, 192, 214,  31, 181, 199, 106, 157,
+  184,  84, 204, 176, 115, 121,  50,  45, 127,   4, 150, 254, 138, 236, 205,  93,
+  222, 114,  67,  29,  24,  72, 243, 141, 128, 195,  78,  66, 215,  61, 156, 180
+};
+
+// Gradients, indexed by 4 hash bits
+static const int8_t grad1[16] = { -8, -7, -6, -5, -4, -3, -2, -1, 1, 2, 3, 4, 5, 6, 7, 8 };
+
+static const int8_t grad2[8][2] = {
+  { 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 }, { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }
+};
+
+static const int8_t grad3[16][3] = { // edges of a cube, 4 repeated
+  { 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+  { 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+  { 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 },
+  { 1, 1, 0 }, { 0, -1, 1 }, { -1, 1, 0 }, { 0, -1, -1 }
+};
+
+
+// Fade curve 6f^5 - 15f^4 + 10f^3 of a fraction as 16 bit weight
+static uint16_t fadeTable[256];
+
+static struct fadeInit {
+  fadeInit() {
+    for( int32_t f = 0; f < 256; f++ ) {
+      int64_t t = f << 8;
+      int64_t t3 = (((t * t) >> 16) * t) >> 16;
+      fadeTable[f] = (t3 * (((t * (6 * t - 15 * 65536)) >> 16) + 10 * 65536)) >> 16;
+    }
+  }
+} fadeInit;
+
+
+static inline int32_t lerp( int32_t a, int32_t b, uint16_t weight ) {
+  return a + (((b - a) * (int32_t)weight) >> 16);
+}
+
+// Scale to the result range
+static inline int16_t clamp16( int32_t v ) {
+  return v < -32767 ? -32767 : (v > 32767 ? 32767 : v);
+}
+
+
+int16_t noise1( int32_t x ) {
+  int32_t ix = x >> 8;
+  int32_t fx = x & 0xff;
+  int32_t a = grad1[perm[ix & 0xff] & 15] * fx;
+  int32_t b = grad1[perm[(ix + 1) & 0xff] & 15] * (fx - 256);
+  return clamp16(lerp(a, b, fadeTable[fx]) * 32);
+}
+
+
+int16_t noise2( int32_t x, int32_t y ) {
+  int32_t ix = x >> 8, iy = y >> 8;
+  int32_t fx = x & 0xff, fy = y & 0xff;
+  int32_t dot[2][2];
+  for( int a = 0; a < 2; a++ ) {
+    uint8_t hx = perm[(ix + a) & 0xff];
+    for( int b = 0; b < 2; b++ ) {
+      const int8_t *g = grad2[perm[(hx + iy + b) & 0xff] & 7];
+      dot[a][b] = (g[0] * (fx - 256 * a) + g[1] * (fy - 256 * b)) * 8;
+    }
+  }
+  uint16_t wx = fadeTable[fx];
+  int32_t n = lerp(lerp(dot[0][0], dot[1][0], wx), lerp(dot[0][1], dot[1][1], wx), fadeTable[fy]);
+  return clamp16(n * 16);
+}
+
+
+int16_t noise3( int32_t x, int32_t y, int32_t z ) {
+  noiseLine line;
+  return line.get(x, y, z);
+}
+
+
+noiseLine::noiseLine() : _valid(false), _cellX(0), _y(0), _z(0),
+  _slope0(0), _offset0(0), _slope1(0), _offset1(0), _cells(0) {
+}
+
+
+int16_t noiseLine::get( int32_t x, int32_t y, int32_t z ) {
+  int32_t cellX = x >> 8;
+  if( !_valid || cellX != _cellX || y != _y || z != _z ) {
+    setup(cellX, y, z);
+  }
+  int32_t fx = x & 0xff;
+  int32_t v0 = ((_slope0 * fx) >> 8) + _offset0;
+  int32_t v1 = ((_slope1 * (fx - 256)) >> 8) + _offset1;
+  return clamp16(lerp(v0, v1, fadeTable[fx]) * 16);
+}
+
+
+// Interpolate the 4 corners of each x face with the fixed y and z fractions.
+// What remains of a face is linear in fx: slope from the x gradients, offset from the y and z parts.
+// Values have 3 more fraction bits than the coordinates, to keep rounding errors small
+void noiseLine::setup( int32_t cellX, int32_t y, int32_t z ) {
+  int32_t iy = y >> 8, iz = z >> 8;
+  int32_t fy = y & 0xff, fz = z & 0xff;
+  uint16_t wy = fadeTable[fy], wz = fadeTable[fz];
+  int32_t slope[2], offset[2];
+
+  for( int a = 0; a < 2; a++ ) {
+    uint8_t hx = perm[(cellX + a) & 0xff];
+    int32_t s[2][2], o[2][2];
+    for( int b = 0; b < 2; b++ ) {
+      uint8_t hy = perm[(hx + iy + b) & 0xff];
+      for( int c = 0; c < 2; c++ ) {
+        const int8_t *g = grad3[perm[(hy + iz + c) & 0xff] & 15];
+        s[b][c] = g[0] * 2048;
+        o[b][c] = (g[1] * (fy - 256 * b) + g[2] * (fz - 256 * c)) * 8;
+      }
+    }
+    slope[a] = lerp(lerp(s[0][0], s[0][1], wz), lerp(s[1][0], s[1][1], wz), wy);
+    offset[a] = lerp(lerp(o[0][0], o[0][1], wz), lerp(o[1][0], o[1][1], wz), wy);
+  }
+
+  _slope0 = slope[0];
+  _offset0 = offset[0];
+  _slope1 = slope[1];
+  _offset1 = offset[1];
+  _cellX = cellX;
+  _y = y;
+  _z = z;
+  _valid = true;
+  _cells++;
+}
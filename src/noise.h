@@ -0,0 +1,38 @@
+#ifndef _noise_h
+#define _noise_h
+
+#include <stdint.h>
+
+// Integer gradient noise (improved Perlin noise) without floats.
+// Coordinates have 8 fraction bits, so 256 is the distance of the lattice cells.
+// Results are smooth values -32767..32767 that are 0 at lattice points.
+
+int16_t noise1( int32_t x );
+int16_t noise2( int32_t x, int32_t y );
+int16_t noise3( int32_t x, int32_t y, int32_t z );
+
+
+// 3D noise evaluated along x, e.g. for the pixels of a strip in one frame.
+// While y and z stay the same, the cell corners are reduced to two linear functions of x once per
+// lattice cell, so each further x in the cell costs two multiplications and an interpolation.
+// Any order of x is valid, walking x in steps below 256 is what makes it fast.
+class noiseLine {
+public:
+  noiseLine();
+
+  int16_t get( int32_t x, int32_t y, int32_t z );
+
+  // Lattice cells set up, to check the incremental evaluation
+  uint32_t cells() const { return _cells; }
+
+private:
+  void setup( int32_t cellX, int32_t y, int32_t z );
+
+  bool _valid;
+  int32_t _cellX, _y, _z;
+  int32_t _slope0, _offset0;  // faces of the cell at x0 and x1: value = slope * fx + offset
+  int32_t _slope1, _offset1;
+  uint32_t _cells;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef _nxproto_h
+#define _nxproto_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// NeoXmas UDP protocol, shared by the firmware and host tools
+
+#define NX_PORT            (('N' << 8) | 'X')
+
+// A packet of pixel blocks has one block per pixel to change: pixel number, r, g, b
+#define NX_BLOCK_SIZE      4
+
+// Largest packet payload that fits an ethernet frame without fragmentation
+#define NX_PACKET_MAX      1472
+
+// Binary control message, sent to the same port.
+// Recognized by its size and magic, so it can't be confused with pixel blocks
+// (unless a strip with 256 pixels gets pixel 255 set to color 'N', 'X', 'C')
+#define CONTROL_MAGIC      "\xffNXC"
+
+#define CONTROL_MODE       0x01  // mode field is valid
+#define CONTROL_CIRCLE     0x02  // msCircle field is valid
+#define CONTROL_BRIGHTNESS 0x04  // brightness field is valid
+#define CONTROL_PAUSE      0x08  // paused field is valid
+#define CONTROL_PERSIST    0x80  // save resulting settings in EEPROM
+
+typedef struct {
+  uint8_t  magic[4];   // CONTROL_MAGIC
+  uint8_t  flags;      // CONTROL_* bits
+  uint8_t  mode;       // new animation mode
+  uint8_t  brightness; // new brightness (0-255)
+  uint8_t  paused;     // 0: run, else pause animation
+  uint32_t msCircle;   // new animation circle (little endian)
+} control_t;
+
+
+// Span packet: pixels of a space shared by several controllers, so one (multicast) packet
+// can update all of them. Header, then r, g, b of count consecutive pixels from start.
+// Each controller takes the pixels within its slice of the shared space.
+// Recognized by its magic, the same caveat as for control messages applies
+#define SPAN_MAGIC         "\xffNXS"
+#define NX_SPAN_PIXELS     ((NX_PACKET_MAX - sizeof(span_t)) / 3)  // max pixels of a span packet
+
+typedef struct {
+  uint8_t  magic[4];   // SPAN_MAGIC
+  uint16_t start;      // first pixel of the shared space (little endian)
+  uint16_t count;      // number of pixels following (little endian)
+} span_t;
+
+
+// Is the packet a binary control message?
+inline bool nxIsControl( const uint8_t *packet, size_t size ) {
+  return size == sizeof(control_t) && memcmp(packet, CONTROL_MAGIC, sizeof(((control_t *)0)->magic)) == 0;
+}
+
+
+// Call set(pixel, r, g, b) for each block of the packet with a pixel number below numPixels.
+// Returns number of complete blocks in the packet
+template<typename F> size_t nxDecodeBlocks( const uint8_t *packet, size_t size, unsigned numPixels, F set ) {
+  size_t blocks = size / NX_BLOCK_SIZE;
+  for( const uint8_t *msg = packet; msg < packet + blocks * NX_BLOCK_SIZE; msg += NX_BLOCK_SIZE ) {
+    if( msg[0] < numPixels ) { // Pixel number valid?
+      set(msg[0], msg[1], msg[2], msg[3]);
+    }
+  }
+  return blocks;
+}
+
+
+// Is the packet a span packet?
+inline bool nxIsSpan( const uint8_t *packet, size_t size ) {
+  return size >= sizeof(span_t) && memcmp(packet, SPAN_MAGIC, sizeof(((span_t *)0)->magic)) == 0;
+}
+
+
+// Call set(pixel, r, g, b) for each pixel of a span packet within the slice of numPixels
+// starting at first in the shared space, with pixel relative to first.
+// Pixels missing in a truncated packet are ignored. Returns number of pixels set
+template<typename F> size_t nxDecodeSpan( const uint8_t *packet, size_t size, unsigned first, unsigned numPixels, F set ) {
+  unsigned start = packet[4] | packet[5] << 8;
+  unsigned count = packet[6] | packet[7] << 8;
+  unsigned complete = (size - sizeof(span_t)) / 3;
+  if( count > complete ) {
+    count = complete;
+  }
+
+  // Intersect span with slice
+  unsigned from = start > first ? start : first;
+  unsigned to = start + count < first + numPixels ? start + count : first + numPixels;
+  for( unsigned pixel = from; pixel < to; pixel++ ) {
+    const uint8_t *rgb = packet + sizeof(span_t) + (pixel - start) * 3;
+    set(pixel - first, rgb[0], rgb[1], rgb[2]);
+  }
+  return from < to ? to - from : 0;
+}
+
+#endif
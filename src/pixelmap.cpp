@@ -0,0 +1,64 @@
+#include <pixelmap.h>
+
+#include <math.h>
+
+
+void mapNormalize( const int32_t coords[][3], position_t positions[], uint16_t numPixels ) {
+  int32_t min[3], max[3];
+  for( int axis = 0; axis < 3; axis++ ) {
+    min[axis] = max[axis] = numPixels ? coords[0][axis] : 0;
+  }
+  for( uint16_t pixel = 1; pixel < numPixels; pixel++ ) {
+    for( int axis = 0; axis < 3; axis++ ) {
+      if( coords[pixel][axis] < min[axis] ) min[axis] = coords[pixel][axis];
+      if( coords[pixel][axis] > max[axis] ) max[axis] = coords[pixel][axis];
+    }
+  }
+
+  // Same scale for all axes, so the longest one spans the int16 range
+  int64_t range = 1;
+  for( int axis = 0; axis < 3; axis++ ) {
+    if( (int64_t)max[axis] - min[axis] > range ) {
+      range = (int64_t)max[axis] - min[axis];
+    }
+  }
+
+  for( uint16_t pixel = 0; pixel < numPixels; pixel++ ) {
+    int16_t *pos = &positions[pixel].x;
+    for( int axis = 0; axis < 3; axis++ ) {
+      int64_t centered = 2 * (int64_t)coords[pixel][axis] - min[axis] - max[axis]; // twice distance to center
+      pos[axis] = (centered * 32767) / range;
+    }
+  }
+}
+
+
+void mapLinear( position_t positions[], uint16_t numPixels ) {
+  for( uint16_t pixel = 0; pixel < numPixels; pixel++ ) {
+    positions[pixel].x = positions[pixel].y = 0;
+    positions[pixel].z = numPixels > 1 ? -32767 + (int32_t)((uint32_t)65534 * pixel / (numPixels - 1)) : 0;
+  }
+}
+
+
+void mapProject( const position_t positions[], projection_t projections[], uint16_t numPixels ) {
+  int16_t zMin = INT16_MAX, zMax = INT16_MIN;
+  float rMax = 0;
+  for( uint16_t pixel = 0; pixel < numPixels; pixel++ ) {
+    const position_t &pos = positions[pixel];
+    if( pos.z < zMin ) zMin = pos.z;
+    if( pos.z > zMax ) zMax = pos.z;
+    float r = sqrtf((float)pos.x * pos.x + (float)pos.y * pos.y + (float)pos.z * pos.z);
+    if( r > rMax ) rMax = r;
+  }
+
+  for( uint16_t pixel = 0; pixel < numPixels; pixel++ ) {
+    const position_t &pos = positions[pixel];
+    projection_t &proj = projections[pixel];
+    // 0xffff times a difference of up to 0xfffe needs all 32 bits, unsigned
+    proj.height = zMax > zMin ? (uint32_t)0xffff * (uint32_t)(pos.z - zMin) / (uint32_t)(zMax - zMin) : 0;
+    float r = sqrtf((float)pos.x * pos.x + (float)pos.y * pos.y + (float)pos.z * pos.z);
+    proj.radius = rMax > 0 ? (uint16_t)(0xffff * r / rMax) : 0;
+    proj.angle = (uint16_t)(int32_t)(atan2f(pos.y, pos.x) * (0x10000 / (2 * M_PI)));
+  }
+}
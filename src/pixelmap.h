@@ -0,0 +1,27 @@
+#ifndef _pixelmap_h
+#define _pixelmap_h
+
+#include <stdint.h>
+
+// Position of a pixel in the installation (z is up), scaled to the int16 range around the center
+typedef struct {
+  int16_t x, y, z;
+} position_t;
+
+// Projections of a pixel position as 16 bit fractions, precomputed for spatial animations
+typedef struct {
+  uint16_t height;  // 0: lowest, 0xffff: highest pixel
+  uint16_t radius;  // distance from center, 0xffff: farthest pixel
+  uint16_t angle;   // around the vertical axis, 0x10000 is a full turn
+} projection_t;
+
+// Scale coordinates (any unit) to positions, keeping the aspect ratio
+void mapNormalize( const int32_t coords[][3], position_t positions[], uint16_t numPixels );
+
+// Default map: pixels on a vertical line from bottom to top
+void mapLinear( position_t positions[], uint16_t numPixels );
+
+// Compute projections of positions
+void mapProject( const position_t positions[], projection_t projections[], uint16_t numPixels );
+
+#endif
@@ -1,6 +1,13 @@
 #include <spark.h>
 
-#include <stdlib.h>
+#include <string.h>
+
+
+uint32_t sparkRandom::_state = 2463534242UL;
+
+void sparkRandom::seed( uint32_t seed ) {
+  _state = seed ? seed : 2463534242UL; // xorshift state must not be 0
+}
 
 
 baseSpark::baseSpark( uint16_t limit, color_t color ) : _color(color), _limit(limit) {
@@ -10,6 +17,17 @@ baseSpark::~baseSpark() {
 }
 
 bool baseSpark::get( uint16_t part, color_t &color ) const {
+  color16_t deep;
+  if( !get(part, deep) ) {
+    return false;
+  }
+  color.r = deep.r >> 8;
+  color.g = deep.g >> 8;
+  color.b = deep.b >> 8;
+  return true;
+}
+
+bool baseSpark::get( uint16_t part, color16_t &color ) const {
   uint32_t r, g, b;
 
   // mirror animation
@@ -31,9 +49,9 @@ bool baseSpark::get( uint16_t part, color_t &color ) const {
   }
   // squared increase (slow for low values, fast for high values)
   // Color change looks better / more even
-  color.r = (uint8_t)((r*r)>>24);
-  color.g = (uint8_t)((g*g)>>24);
-  color.b = (uint8_t)((b*b)>>24);
+  color.r = (uint16_t)((r*r)>>16);
+  color.g = (uint16_t)((g*g)>>16);
+  color.b = (uint16_t)((b*b)>>16);
 
   /*
   if( millis() < 12000 )
@@ -57,19 +75,22 @@ randomSpark::randomSpark( uint16_t limit ) : baseSpark(limit) {
 }
 
 void randomSpark::reset() {
-  switch( map(rand() % 0xffff, 0, 0xffff, 0, 2) ) {
+  uint32_t rnd = sparkRandom::next();
+  uint8_t value = rnd; // low byte is random color part
+
+  switch( ((rnd >> 16) * 3) >> 16 ) {
     case 0:
       _color.r = 0xff;
-      _color.g = map(rand() % 0xffff, 0, 0xffff, 0, 0xff);
+      _color.g = value;
       _color.b = 0;
       break;
     case 1:
       _color.r = 0;
       _color.g = 0xff;
-      _color.b = map(rand() % 0xffff, 0, 0xffff, 0, 0xff);
+      _color.b = value;
       break;
     case 2:
-      _color.r = map(rand() % 0xffff, 0, 0xffff, 0, 0xff);
+      _color.r = value;
       _color.g = 0;
       _color.b = 0xff;
       break;
@@ -77,57 +98,99 @@ void randomSpark::reset() {
 }
 
 
-const themedSpark::color_t *themedSpark::_colors = 0;
-uint16_t themedSpark::_numColors = 0;
+sparkPalette::sparkPalette() {
+  memset(_colors, 0xff, sizeof(_colors));
+}
 
-themedSpark::themedSpark( uint16_t limit ) : baseSpark(limit) {
+void sparkPalette::set( const color_t colors[], uint16_t numColors ) {
+  if( !numColors ) {
+    return;
+  }
+  for( uint16_t i = 0; i < SIZE; i++ ) {
+    _colors[i] = colors[(i * numColors) / SIZE];
+  }
+}
+
+void sparkPalette::gradient( const color_t colors[], uint16_t numColors ) {
+  if( numColors < 2 ) {
+    set(colors, numColors);
+    return;
+  }
+  // Entry i is at position i * (numColors-1) / (SIZE-1) between the given colors (16 bit fraction)
+  for( uint16_t i = 0; i < SIZE; i++ ) {
+    uint32_t pos = ((uint32_t)i * (numColors - 1) << 16) / (SIZE - 1);
+    uint16_t from = pos >> 16;
+    uint32_t frac = pos & 0xffff;
+    if( from >= numColors - 1 ) {
+      _colors[i] = colors[numColors - 1];
+      continue;
+    }
+    const color_t &a = colors[from];
+    const color_t &b = colors[from + 1];
+    _colors[i].r = a.r + (((int32_t)b.r - a.r) * (int32_t)frac >> 16);
+    _colors[i].g = a.g + (((int32_t)b.g - a.g) * (int32_t)frac >> 16);
+    _colors[i].b = a.b + (((int32_t)b.b - a.b) * (int32_t)frac >> 16);
+  }
+}
+
+
+themedSpark::themedSpark( uint16_t limit ) : baseSpark(limit), _palette(0) {
   reset();
 }
 
 void themedSpark::reset() {
-  if( _numColors && _colors ) {
-    _color = _colors[((rand() % 0x10000) * _numColors) / 0xffff];
+  if( _palette ) {
+    _color = _palette->get(sparkRandom::next() >> 24);
   }
   else {
     _color.r = _color.g = _color.b = 0xff;
   }
 }
 
-void themedSpark::setTheme( const color_t colors[], uint16_t numColors ) {
-  _colors = colors;
-  _numColors = numColors;
+void themedSpark::setTheme( const sparkPalette *palette ) {
+  _palette = palette;
 }
 
 
 timedSpark::timedSpark() : _pSpark(0), _msMin(0), _ms(0), _intervals(0), _started(0) {
 }
 
-timedSpark::timedSpark( baseSpark *pSpark, uint16_t ms, uint16_t intervals ) {
-  setSpark(pSpark, ms, intervals);
+timedSpark::timedSpark( baseSpark *pSpark, uint16_t ms, uint32_t now, uint16_t intervals ) {
+  setSpark(pSpark, ms, now, intervals);
 }
 
-bool timedSpark::get( color_t &color ) {
+bool timedSpark::get( uint32_t now, color_t &color ) {
   if( !_pSpark || !_ms ) {
     color.r = color.g = color.b = 0xff;
     return true;
   }
+  return _pSpark->get(part(now), color);
+}
+
+bool timedSpark::get( uint32_t now, color16_t &color ) {
+  if( !_pSpark || !_ms ) {
+    color.r = color.g = color.b = 0xffff;
+    return true;
+  }
+  return _pSpark->get(part(now), color);
+}
 
-  uint32_t now = millis();
+uint16_t timedSpark::part( uint32_t now ) {
   if( _intervals && (((now - _started) / _ms) >= _intervals) ) {
-    _ms = _msMin + rand() % _msMin;
+    _ms = _msMin + sparkRandom::below(_msMin);
     _started = now;
     _pSpark->reset();
   }
 
-  //Serial.printf("value %u, ms %u, map %06lx\n", (now - _started) % _ms, _ms, map((now - _started) % _ms, 0, _ms, 0, 0xffff));
+  //Serial.printf("value %u, ms %u, part %06lx\n", (now - _started) % _ms, _ms, ((now - _started) % _ms) * 0xffff / _ms);
 
-  return _pSpark->get(map((now - _started) % _ms, 0, _ms, 0, 0xffff), color);
+  return ((now - _started) % _ms) * 0xffffUL / _ms;
 }
 
-void timedSpark::setSpark( baseSpark *pSpark, uint16_t ms, uint16_t intervals ) {
+void timedSpark::setSpark( baseSpark *pSpark, uint16_t ms, uint32_t now, uint16_t intervals ) {
   _pSpark = pSpark;
   _msMin = ms;
-  _ms = _msMin + rand() % _msMin;
+  _ms = _msMin + sparkRandom::below(_msMin);
   _intervals = intervals;
-  _started = millis();
+  _started = now;
 }
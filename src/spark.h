@@ -2,16 +2,43 @@
 #ifndef _spark_h
 #define _spark_h
 
-#include <Arduino.h>
+#include <stdint.h>
+
+#include <deepcolor.h>
 
 // when in the range of 0-0xffff the spark reaches its color and begins to turn white
 #define SPARK_LIMIT 0xf000
 
+// Fast deterministic pseudo random numbers (xorshift32) used by all sparks.
+// Same seed gives same sequence on every platform
+class sparkRandom {
+public:
+  static void seed( uint32_t seed );
+
+  // return next 32 bit random number
+  static uint32_t next() {
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return _state;
+  }
+
+  // return random number between 0 and n-1 (n <= 0x10000)
+  static uint32_t below( uint32_t n ) {
+    return ((next() >> 16) * n) >> 16;
+  }
+
+private:
+  static uint32_t _state;
+};
+
+
 // A spark defines a target color to blend to from black for range values between 0 and limit
 // and on to white from limit to uint16_max
 class baseSpark {
 public:
   typedef struct { uint8_t r, g, b; } color_t;
+  typedef ::color16_t color16_t;
 
   baseSpark( uint16_t limit = SPARK_LIMIT, color_t color = {0xff, 0xff, 0xff} );
   virtual ~baseSpark();
@@ -19,6 +46,9 @@ public:
   // return the color blend mapped to the given partial interval value (between 0 and uint16_max)
   virtual bool get( uint16_t part, color_t &color ) const;
 
+  // same with 16 bits per channel
+  virtual bool get( uint16_t part, color16_t &color ) const;
+
   virtual void reset();
   void setLimit( uint16_t limit );
 
@@ -38,17 +68,40 @@ public:
 };
 
 
-// A spark with a random color out of a given array of colors (theme)
+// 256 theme colors, so a random theme color is a single lookup
+class sparkPalette {
+public:
+  typedef baseSpark::color_t color_t;
+  static const uint16_t SIZE = 256;
+
+  sparkPalette(); // all white
+
+  // Each color gets an equal share of the palette
+  void set( const color_t colors[], uint16_t numColors );
+
+  // Colors blend into each other along the palette
+  void gradient( const color_t colors[], uint16_t numColors );
+
+  const color_t &get( uint8_t index ) const { return _colors[index]; }
+
+  // Raw palette data, e.g. for saving
+  color_t *data() { return _colors; }
+
+private:
+  color_t _colors[SIZE];
+};
+
+
+// A spark with a random color out of a palette (theme)
 class themedSpark : public baseSpark {
 public:
   themedSpark( uint16_t limit = SPARK_LIMIT );
   void reset() override;
 
-  static void setTheme( const color_t colors[], uint16_t numColors );
+  void setTheme( const sparkPalette *palette );
 
 private:
-  static const color_t *_colors;
-  static uint16_t _numColors;
+  const sparkPalette *_palette;
 };
 
 
@@ -56,18 +109,23 @@ private:
 class timedSpark {
 public:
   typedef baseSpark::color_t color_t;
+  typedef baseSpark::color16_t color16_t;
 
   timedSpark();
-  timedSpark( baseSpark *pSpark, uint16_t ms, uint16_t intervals = 1 );
+  timedSpark( baseSpark *pSpark, uint16_t ms, uint32_t now, uint16_t intervals = 1 );
 
   // Resets spark, if intervals are over.
-  // Returns color for current time in interval or false if sparks get() fails
-  bool get( color_t &color );
+  // Returns color for time now (ms) in interval or false if sparks get() fails
+  bool get( uint32_t now, color_t &color );
+  bool get( uint32_t now, color16_t &color );
 
-  // configure the spark to handle
-  void setSpark( baseSpark *pSpark, uint16_t ms, uint16_t intervals = 1 );
+  // configure the spark to handle, starting at time now (ms)
+  void setSpark( baseSpark *pSpark, uint16_t ms, uint32_t now, uint16_t intervals = 1 );
 
 private:
+  // Resets spark, if intervals are over. Returns range value for time now
+  uint16_t part( uint32_t now );
+
   baseSpark *_pSpark;
   uint16_t _msMin;
   uint16_t _ms;
@@ -0,0 +1,127 @@
+#ifndef _stripanim_h
+#define _stripanim_h
+
+#include <stdint.h>
+
+// Animation and output code specialized at compile time for the strip length and color order.
+// Tables depending only on those are generated by the compiler, so the animators need no floats
+// and no per pixel setup, and frames are written into the strip buffer in its native byte order.
+
+
+// Sine of a 16 bit angle (65536 is a full turn) as -32767..32767.
+// Interpolates a table of SINE_STEPS per turn, error is below 5/32767
+#define SINE_STEPS 256
+
+// Taylor series, only to generate the table at compile time
+constexpr double sineTaylor( double x ) {
+  const double pi = 3.14159265358979323846;
+  while( x > pi ) {
+    x -= 2 * pi;
+  }
+  double term = x;
+  double sum = x;
+  for( int n = 1; n < 12; n++ ) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+struct sineTable {
+  int16_t v[SINE_STEPS + 1];  // one more for interpolating the last step
+
+  constexpr sineTable() : v() {
+    for( int i = 0; i <= SINE_STEPS; i++ ) {
+      double s = 32767 * sineTaylor(2 * 3.14159265358979323846 * i / SINE_STEPS);
+      v[i] = (int16_t)(s < 0 ? s - 0.5 : s + 0.5);
+    }
+  }
+};
+
+static constexpr sineTable sines;
+
+static inline int32_t sin16( uint16_t angle ) {
+  uint32_t step = angle / (65536 / SINE_STEPS);
+  int32_t frac = angle % (65536 / SINE_STEPS);
+  int32_t a = sines.v[step];
+  return a + (((sines.v[step + 1] - a) * frac) >> 8);
+}
+
+
+// Angle of each pixel for one full turn along a strip of N pixels
+template<unsigned N>
+struct stripPhases {
+  uint16_t v[N];
+
+  constexpr stripPhases() : v() {
+    for( unsigned i = 0; i < N; i++ ) {
+      v[i] = (uint16_t)(((uint32_t)i << 16) / N);
+    }
+  }
+};
+
+template<unsigned N>
+struct stripTables {
+  static constexpr stripPhases<N> phases{};
+};
+
+template<unsigned N>
+constexpr stripPhases<N> stripTables<N>::phases;
+
+
+// Sine wave interferences like sine_waves() in animations.cpp: red, green and blue waves of one
+// turn per circle with -1, 3 and 2 waves along the strip, squared for perceived brightness
+template<unsigned N>
+uint32_t stripSineWaves( uint32_t t, unsigned pixel, uint32_t msCircle ) {
+  uint16_t time = ((uint64_t)(t % msCircle) << 16) / msCircle;
+  uint16_t phase = stripTables<N>::phases.v[pixel];
+
+  uint32_t red   = (127 * sin16(time - phase)) / 32768 + 127;
+  uint32_t green = (127 * sin16(time + 3 * phase)) / 32768 + 127;
+  uint32_t blue  = (127 * sin16(time + 2 * phase)) / 32768 + 127;
+
+  red   = (red   * red  ) / 254;
+  green = (green * green) / 254;
+  blue  = (blue  * blue ) / 254;
+
+  return red << 16 | green << 8 | blue;
+}
+
+
+// Positions of red, green and blue in the 3 bytes of a pixel in a strip buffer
+template<unsigned R, unsigned G, unsigned B>
+struct colorOrder {
+  static const unsigned r = R;
+  static const unsigned g = G;
+  static const unsigned b = B;
+};
+
+typedef colorOrder<0, 1, 2> orderRgb;
+typedef colorOrder<1, 0, 2> orderGrb;
+
+
+// Write count colors 0xRRGGBB into a strip buffer with 3 bytes per pixel in ORDER
+template<typename ORDER>
+void writeSpan( uint8_t *buffer, const uint32_t colors[], uint16_t count ) {
+  for( uint16_t i = 0; i < count; i++, buffer += 3 ) {
+    uint32_t color = colors[i];
+    buffer[ORDER::r] = color >> 16;
+    buffer[ORDER::g] = color >> 8;
+    buffer[ORDER::b] = color;
+  }
+}
+
+// Same with the first color at the last pixel
+template<typename ORDER>
+void writeSpanReversed( uint8_t *buffer, const uint32_t colors[], uint16_t count ) {
+  buffer += 3 * count;
+  for( uint16_t i = 0; i < count; i++ ) {
+    buffer -= 3;
+    uint32_t color = colors[i];
+    buffer[ORDER::r] = color >> 16;
+    buffer[ORDER::g] = color >> 8;
+    buffer[ORDER::b] = color;
+  }
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include <vm.h>
+#include <noise.h>
+#include <stripanim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Opcodes
+enum {
+  OP_PUSH,
+  OP_T, OP_C, OP_P, OP_I, OP_N, OP_X, OP_Y, OP_Z, OP_H, OP_R, OP_A,
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_AND, OP_OR, OP_XOR, OP_SHL, OP_SHR, OP_MIN, OP_MAX, OP_FMUL,
+  OP_NEG, OP_ABS, OP_SIN, OP_NOISE, OP_PAL,
+  OP_DUP, OP_DROP, OP_SWAP, OP_OVER, OP_SELECT, OP_RGB
+};
+
+// Source words, their opcodes and stack effect
+static const struct {
+  const char *name;
+  uint8_t op;
+  uint8_t pops;
+  uint8_t pushes;
+} words[] = {
+  { "t", OP_T, 0, 1 }, { "c", OP_C, 0, 1 }, { "p", OP_P, 0, 1 }, { "i", OP_I, 0, 1 },
+  { "n", OP_N, 0, 1 }, { "x", OP_X, 0, 1 }, { "y", OP_Y, 0, 1 }, { "z", OP_Z, 0, 1 },
+  { "h", OP_H, 0, 1 }, { "r", OP_R, 0, 1 }, { "a", OP_A, 0, 1 },
+  { "+", OP_ADD, 2, 1 }, { "-", OP_SUB, 2, 1 }, { "*", OP_MUL, 2, 1 }, { "/", OP_DIV, 2, 1 },
+  { "%", OP_MOD, 2, 1 }, { "&", OP_AND, 2, 1 }, { "|", OP_OR, 2, 1 }, { "^", OP_XOR, 2, 1 },
+  { "<<", OP_SHL, 2, 1 }, { ">>", OP_SHR, 2, 1 }, { "min", OP_MIN, 2, 1 }, { "max", OP_MAX, 2, 1 },
+  { "fmul", OP_FMUL, 2, 1 },
+  { "neg", OP_NEG, 1, 1 }, { "abs", OP_ABS, 1, 1 }, { "sin", OP_SIN, 1, 1 }, { "noise", OP_NOISE, 1, 1 },
+  { "pal", OP_PAL, 1, 1 },
+  { "dup", OP_DUP, 1, 2 }, { "drop", OP_DROP, 1, 0 }, { "swap", OP_SWAP, 2, 2 }, { "over", OP_OVER, 2, 3 },
+  { "?", OP_SELECT, 3, 1 }, { "rgb", OP_RGB, 3, 1 }
+};
+
+
+static inline int32_t clamp8( int32_t v ) {
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+
+vmProgram::vmProgram() : _size(0), _palette(0) {
+  _error[0] = '\0';
+}
+
+bool vmProgram::compile( const char *source ) {
+  uint16_t size = 0;
+  int depth = 0;
+  const char *pos = source;
+
+  _size = 0;
+  _error[0] = '\0';
+
+  while( *pos ) {
+    while( *pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n' ) {
+      pos++;
+    }
+    if( !*pos ) {
+      break;
+    }
+    const char *word = pos;
+    while( *pos && *pos != ' ' && *pos != '\t' && *pos != '\r' && *pos != '\n' ) {
+      pos++;
+    }
+    size_t len = pos - word;
+
+    if( size == MAX_CODE ) {
+      snprintf(_error, sizeof(_error), "more than %u words", MAX_CODE);
+      return false;
+    }
+
+    instruction_t &ins = _code[size++];
+    char *end;
+    long value = strtol(word, &end, 0);
+    if( end == pos ) {
+      ins.op = OP_PUSH;
+      ins.arg = value;
+      depth++;
+    }
+    else {
+      size_t w = 0;
+      while( w < sizeof(words)/sizeof(*words) && (strlen(words[w].name) != len || strncmp(words[w].name, word, len) != 0) ) {
+        w++;
+      }
+      if( w == sizeof(words)/sizeof(*words) ) {
+        snprintf(_error, sizeof(_error), "unknown word at %u", (unsigned)(word - source));
+        return false;
+      }
+      if( depth < words[w].pops ) {
+        snprintf(_error, sizeof(_error), "stack empty at %u", (unsigned)(word - source));
+        return false;
+      }
+      ins.op = words[w].op;
+      ins.arg = 0;
+      depth += words[w].pushes - words[w].pops;
+    }
+
+    if( depth > MAX_STACK ) {
+      snprintf(_error, sizeof(_error), "stack full at %u", (unsigned)(word - source));
+      return false;
+    }
+  }
+
+  if( depth != 1 ) {
+    snprintf(_error, sizeof(_error), "%d values left instead of one color", depth);
+    return false;
+  }
+
+  _size = size;
+  return true;
+}
+
+uint32_t vmProgram::run( const vmInputs_t &in ) const {
+  int32_t stack[MAX_STACK];
+  int32_t *sp = stack; // next free entry, stack usage was checked by compile()
+
+  for( const instruction_t *ins = _code; ins < _code + _size; ins++ ) {
+    switch( ins->op ) {
+      case OP_PUSH:  *sp++ = ins->arg; break;
+      case OP_T:     *sp++ = in.t; break;
+      case OP_C:     *sp++ = in.circle; break;
+      case OP_P:     *sp++ = in.phase; break;
+      case OP_I:     *sp++ = in.pixel; break;
+      case OP_N:     *sp++ = in.pixels; break;
+      case OP_X:     *sp++ = in.x; break;
+      case OP_Y:     *sp++ = in.y; break;
+      case OP_Z:     *sp++ = in.z; break;
+      case OP_H:     *sp++ = in.height; break;
+      case OP_R:     *sp++ = in.radius; break;
+      case OP_A:     *sp++ = in.angle; break;
+
+      // Wrap around in 32 bits instead of overflowing, -1 divisors can't overflow
+      case OP_ADD:   sp--; sp[-1] = (uint32_t)sp[-1] + (uint32_t)sp[0]; break;
+      case OP_SUB:   sp--; sp[-1] = (uint32_t)sp[-1] - (uint32_t)sp[0]; break;
+      case OP_MUL:   sp--; sp[-1] = (uint32_t)sp[-1] * (uint32_t)sp[0]; break;
+      case OP_DIV:
+        sp--;
+        sp[-1] = sp[0] == -1 ? -(uint32_t)sp[-1] : sp[0] ? sp[-1] / sp[0] : 0;
+        break;
+      case OP_MOD:   sp--; sp[-1] = sp[0] != -1 && sp[0] ? sp[-1] % sp[0] : 0; break;
+      case OP_AND:   sp--; sp[-1] &= sp[0]; break;
+      case OP_OR:    sp--; sp[-1] |= sp[0]; break;
+      case OP_XOR:   sp--; sp[-1] ^= sp[0]; break;
+      case OP_SHL:   sp--; sp[-1] = (uint32_t)sp[-1] << (sp[0] & 31); break;
+      case OP_SHR:   sp--; sp[-1] >>= (sp[0] & 31); break;
+      case OP_MIN:   sp--; if( sp[0] < sp[-1] ) sp[-1] = sp[0]; break;
+      case OP_MAX:   sp--; if( sp[0] > sp[-1] ) sp[-1] = sp[0]; break;
+      case OP_FMUL:  sp--; sp[-1] = ((int64_t)sp[-1] * sp[0]) >> 16; break;
+
+      case OP_NEG:   sp[-1] = -(uint32_t)sp[-1]; break;
+      case OP_ABS:   if( sp[-1] < 0 ) sp[-1] = -(uint32_t)sp[-1]; break;
+      case OP_SIN:   sp[-1] = sin16(sp[-1]); break;  // 0x10000 is a full circle
+      case OP_NOISE: sp[-1] = noise1(sp[-1]) + 32768; break;
+      case OP_PAL:
+        if( _palette ) {
+          const sparkPalette::color_t &color = _palette->get(sp[-1] & 0xff);
+          sp[-1] = color.r << 16 | color.g << 8 | color.b;
+        }
+        else {
+          sp[-1] = 0xffffff;
+        }
+        break;
+
+      case OP_DUP:   sp[0] = sp[-1]; sp++; break;
+      case OP_DROP:  sp--; break;
+      case OP_SWAP:  { int32_t v = sp[-1]; sp[-1] = sp[-2]; sp[-2] = v; } break;
+      case OP_OVER:  sp[0] = sp[-2]; sp++; break;
+      case OP_SELECT: sp -= 2; sp[-1] = sp[-1] ? sp[0] : sp[1]; break;
+      case OP_RGB:   sp -= 2; sp[-1] = clamp8(sp[-1]) << 16 | clamp8(sp[0]) << 8 | clamp8(sp[1]); break;
+    }
+  }
+
+  return _size ? (uint32_t)stack[0] & 0xffffff : 0;
+}
@@ -0,0 +1,64 @@
+#ifndef _vm_h
+#define _vm_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <spark.h>
+
+// Inputs of a program, set for each pixel
+typedef struct {
+  int32_t t;        // time in ms
+  int32_t circle;   // ms of an animation circle
+  int32_t phase;    // time in circle, 0x10000 is a full circle
+  int32_t pixel;    // pixel index
+  int32_t pixels;   // number of pixels
+  int32_t x, y, z;  // pixel map position (int16 range)
+  int32_t height;   // pixel map projections (16 bit fractions)
+  int32_t radius;
+  int32_t angle;
+} vmInputs_t;
+
+
+// Stack machine evaluating a color expression per pixel.
+// Source is in reverse polish notation, e.g. "p i 1000 * + sin 8 >> 128 + 0 0 rgb".
+// Compiled once into a flat array of instructions with verified stack usage.
+//
+// Values: decimal or 0x numbers, t c p i n x y z h r a (see vmInputs_t)
+// Binary: + - * / % & | ^ << >> min max fmul (16.16 fixed point multiply)
+// Unary:  neg abs sin (phase 0-0xffff -> -32767..32767) noise (8 fraction bits -> 0-0xffff)
+//         pal (palette index 0-255 -> color)
+// Other:  dup drop swap over ? (cond a b -> a if cond else b) rgb (r g b -> color, clamped)
+// The one value left on the stack is the color 0xRRGGBB.
+class vmProgram {
+public:
+  static const uint16_t MAX_CODE = 64;
+  static const uint8_t MAX_STACK = 16;
+
+  vmProgram();
+
+  // Compile source. On error returns false and sets error() and the program is empty
+  bool compile( const char *source );
+
+  // Evaluate the program for one pixel
+  uint32_t run( const vmInputs_t &in ) const;
+
+  // Palette used by op pal
+  void setPalette( const sparkPalette *palette ) { _palette = palette; }
+
+  bool empty() const { return _size == 0; }
+  const char *error() const { return _error; }
+
+private:
+  typedef struct {
+    uint8_t op;
+    int32_t arg;
+  } instruction_t;
+
+  instruction_t _code[MAX_CODE];
+  uint16_t _size;
+  const sparkPalette *_palette;
+  char _error[48];
+};
+
+#endif
@@ -0,0 +1,43 @@
+#!/usr/bin/python
+
+# Example sending a binary control message to NeoXmas via UDP
+# Usage: udp_ctl.py [mode=N] [circle=MS] [brightness=0-255] [pause=0|1] [persist]
+
+import socket
+import struct
+import sys
+
+UDP_IP = socket.gethostbyname("neoXmas")
+UDP_PORT = ord('N') << 8 | ord('X')
+
+MODE       = 0x01
+CIRCLE     = 0x02
+BRIGHTNESS = 0x04
+PAUSE      = 0x08
+PERSIST    = 0x80
+
+flags = 0
+mode = circle = brightness = pause = 0
+for arg in sys.argv[1:]:
+  name, _, value = arg.partition('=')
+  if name == 'mode':
+    flags |= MODE
+    mode = int(value)
+  elif name == 'circle':
+    flags |= CIRCLE
+    circle = int(value)
+  elif name == 'brightness':
+    flags |= BRIGHTNESS
+    brightness = int(value)
+  elif name == 'pause':
+    flags |= PAUSE
+    pause = int(value)
+  elif name == 'persist':
+    flags |= PERSIST
+  else:
+    sys.exit("unknown parameter " + arg)
+
+MESSAGE = b'\xffNXC' + struct.pack('<BBBBI', flags, mode, brightness, pause, circle)
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+sock.sendto(MESSAGE, (UDP_IP, UDP_PORT))